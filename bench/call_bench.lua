@@ -0,0 +1,62 @@
+--[[
+  cost of the frequently called functions.
+
+  usage: lua call_bench.lua [count]
+
+  each line of the output is the tab separated values as follows;
+
+    call <function> <form> <count> <nsec/call> nsec/call
+--]]
+local process = require('process');
+local clock = process.clock;
+local COUNT = tonumber( _G.arg[1] ) or 100000;
+local RUSAGE_SELF = process.RUSAGE_SELF;
+
+
+local function bench( name, form, fn )
+    local elapsed = clock();
+
+    for _ = 1, COUNT do
+        fn();
+    end
+    elapsed = clock() - elapsed;
+
+    print( ('call\t%s\t%s\t%d\t%.2f\tnsec/call'):format(
+        name, form, COUNT, elapsed / COUNT
+    ));
+end
+
+
+local usage = {};
+
+bench( 'getrusage', 'table', function()
+    return process.getrusage();
+end);
+bench( 'getrusage', 'fill', function()
+    return process.getrusage( RUSAGE_SELF, usage );
+end);
+bench( 'getrusage', 'fields', function()
+    return process.getrusage( RUSAGE_SELF, 'utime', 'stime' );
+end);
+bench( 'getenv', 'all', function()
+    return process.getenv();
+end);
+bench( 'getenv', 'snapshot', function()
+    return process.getenv( true );
+end);
+bench( 'getenv', 'name', function()
+    return process.getenv( 'PATH' );
+end);
+bench( 'gettimeofday', '-', function()
+    return process.gettimeofday();
+end);
+bench( 'clock', 'monotonic', function()
+    return clock();
+end);
+bench( 'stats', 'fill', (function()
+    local tbl = {};
+
+    return function()
+        return process.stats( tbl );
+    end
+end)());
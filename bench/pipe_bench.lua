@@ -0,0 +1,79 @@
+--[[
+  pipe throughput of child:read(), child:readinto() and child:stdin().
+
+  usage: lua pipe_bench.lua [size(MB)]
+
+  each line of the output is the tab separated values as follows;
+
+    pipe <method> <chunk-size> <bytes> <MB/sec> MB/sec
+--]]
+local process = require('process');
+local exec = process.exec;
+local clock = process.clock;
+local SIZE = ( tonumber( _G.arg[1] ) or 256 ) * 1024 * 1024;
+local CHUNKS = { 4096, 65536, 1048576 };
+
+
+local function report( method, chunk, elapsed )
+    print( ('pipe\t%s\t%d\t%d\t%.2f\tMB/sec'):format(
+        method, chunk, SIZE, SIZE / 1048576 / ( elapsed / 1e9 )
+    ));
+end
+
+
+local function producer()
+    return assert( exec( 'head', { '-c', tostring( SIZE ), '/dev/zero' }, nil, {
+        stdio = { stdin = 'null', stderr = 'null' }
+    }));
+end
+
+
+-- stdout throughput
+for _, chunk in ipairs( CHUNKS ) do
+    local child = producer();
+    local elapsed = clock();
+    local total = 0;
+    local data = child:read( 'stdout', chunk );
+
+    while data do
+        total = total + #data;
+        data = child:read( 'stdout', chunk );
+    end
+    report( 'read', chunk, clock() - elapsed );
+    assert( total == SIZE );
+    child:wait();
+end
+
+-- stdout throughput without creating strings
+for _, chunk in ipairs( CHUNKS ) do
+    local child = producer();
+    local buf = process.buffer( chunk );
+    local elapsed = clock();
+    local total = 0;
+    local len = child:readinto( 'stdout', buf, chunk );
+
+    while len do
+        total = total + len;
+        buf:reset();
+        len = child:readinto( 'stdout', buf, chunk );
+    end
+    report( 'readinto', chunk, clock() - elapsed );
+    assert( total == SIZE );
+    child:wait();
+end
+
+-- stdin throughput
+for _, chunk in ipairs( CHUNKS ) do
+    local child = assert( exec( 'sh', { '-c', 'cat > /dev/null' }, nil, {
+        stdio = { stdout = 'null', stderr = 'null' }
+    }));
+    local data = string.rep( 'x', chunk );
+    local elapsed = clock();
+
+    for _ = 1, SIZE / chunk do
+        assert( child:stdin( data ) == chunk );
+    end
+    report( 'stdin', chunk, clock() - elapsed );
+    child:kill();
+    child:wait();
+end
@@ -0,0 +1,85 @@
+--[[
+  latency to reap a large number of exited children at once.
+
+  usage: lua reap_bench.lua [count]
+
+  each line of the output is the tab separated values as follows;
+
+    reap <method> - <count> <usec> usec
+
+  NOTE: the count may be limited by RLIMIT_NPROC.
+--]]
+local process = require('process');
+local exec = process.exec;
+local clock = process.clock;
+local waitpid = process.waitpid;
+local COUNT = tonumber( _G.arg[1] ) or 10000;
+local OPTS = { stdio = 'null' };
+
+
+local function report( method, elapsed )
+    print( ('reap\t%s\t-\t%d\t%.2f\tusec'):format(
+        method, COUNT, elapsed / 1e3
+    ));
+end
+
+
+-- spawn children that exit immediately and wait for all of them to exit
+local function spawn()
+    local pids = {};
+
+    for i = 1, COUNT do
+        local child = assert( exec( 'true', nil, nil, OPTS ) );
+
+        pids[i] = child:pid();
+        -- release the process descriptor
+        if i % 256 == 0 then
+            collectgarbage('step');
+        end
+    end
+    process.sleep( 1 );
+
+    return pids;
+end
+
+
+local function bench( method, fn )
+    local elapsed;
+
+    spawn();
+    elapsed = clock();
+    assert( fn() == COUNT );
+    report( method, clock() - elapsed );
+end
+
+
+bench( 'waitpid', function()
+    local n = 0;
+
+    local status = waitpid( -1, process.WNOHANG );
+
+    while status and not status.nochild do
+        n = n + 1;
+        status = waitpid( -1, process.WNOHANG );
+    end
+
+    return n;
+end);
+
+bench( 'reap', function()
+    return process.reap().n;
+end);
+
+bench( 'reap-reuse', (function()
+    local list = {};
+
+    -- allocate the entries in advance
+    process.reap( nil, list );
+    for i = 1, COUNT do
+        list[i] = {};
+    end
+
+    return function()
+        return process.reap( nil, list ).n;
+    end
+end)());
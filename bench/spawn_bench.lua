@@ -0,0 +1,71 @@
+--[[
+  spawn throughput of exec() against the size of the parent process.
+
+  usage: lua spawn_bench.lua [count [max-heap-size(MB)]]
+
+  each line of the output is the tab separated values as follows;
+
+    spawn <mode> <heap-size(MB)> <count> <spawns/sec> spawns/sec
+
+  the throughput of the default (vfork) mode should be flat as the heap
+  grows, while the throughput of the fork mode drops with the heap size.
+--]]
+local process = require('process');
+local exec = process.exec;
+local clock = process.clock;
+local COUNT = tonumber( _G.arg[1] ) or 200;
+local MAXHEAP = tonumber( _G.arg[2] ) or 4096;
+local MB = 1024 * 1024;
+local HEAP = {};
+
+
+-- grow the heap to the specified size with distinct strings
+local function grow( size )
+    local fill = string.rep( 'x', MB - 8 );
+
+    for i = #HEAP + 1, size do
+        HEAP[i] = ('%08d'):format( i ) .. fill;
+    end
+end
+
+
+local function report( mode, size, elapsed )
+    print( ('spawn\t%s\t%d\t%d\t%.2f\tspawns/sec'):format(
+        mode, size, COUNT, COUNT / ( elapsed / 1e9 )
+    ));
+end
+
+
+local function bench( mode, size )
+    local opts = { fork = mode == 'fork', stdio = 'null' };
+    local spawn = function()
+        return exec( 'true', nil, nil, opts );
+    end
+    local elapsed;
+
+    -- precompiled command
+    if mode == 'command' then
+        local cmd = assert( process.command( 'true', nil, nil, opts ) );
+
+        spawn = function()
+            return cmd:spawn();
+        end
+    end
+
+    elapsed = clock();
+    for _ = 1, COUNT do
+        assert( spawn() ):wait();
+    end
+    report( mode, size, clock() - elapsed );
+end
+
+
+for _, size in ipairs({ 0, 64, 256, 1024, 2048, 4096 }) do
+    if size > MAXHEAP then
+        break;
+    end
+    grow( size );
+    bench( 'vfork', size );
+    bench( 'fork', size );
+    bench( 'command', size );
+end
@@ -0,0 +1,163 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/buffer.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+
+
+static inline int pull_lua( lua_State *L, int consume )
+{
+    pbuf_t *b = luaL_checkudata( L, 1, PROCESS_BUFFER_MT );
+    size_t len = pbuf_len( b );
+    lua_Integer n = luaL_optinteger( L, 2, (lua_Integer)len );
+
+    luaL_argcheck( L, n >= 0, 2, "n must be greater than or equal to 0" );
+    if( !len ){
+        lua_pushnil( L );
+        return 1;
+    }
+    else if( (size_t)n < len ){
+        len = (size_t)n;
+    }
+
+    lua_pushlstring( L, pbuf_data( b ), len );
+    if( consume ){
+        pbuf_consume( b, len );
+    }
+
+    return 1;
+}
+
+
+static int peek_lua( lua_State *L )
+{
+    return pull_lua( L, 0 );
+}
+
+
+static int read_lua( lua_State *L )
+{
+    return pull_lua( L, 1 );
+}
+
+
+static int reset_lua( lua_State *L )
+{
+    pbuf_t *b = luaL_checkudata( L, 1, PROCESS_BUFFER_MT );
+
+    pbuf_consume( b, pbuf_len( b ) );
+
+    return 0;
+}
+
+
+static int len_lua( lua_State *L )
+{
+    pbuf_t *b = luaL_checkudata( L, 1, PROCESS_BUFFER_MT );
+
+    lua_pushinteger( L, (lua_Integer)pbuf_len( b ) );
+
+    return 1;
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    pbuf_dispose( (pbuf_t*)lua_touserdata( L, 1 ) );
+
+    return 0;
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    lua_pushfstring( L, PROCESS_BUFFER_MT ": %p", lua_touserdata( L, 1 ) );
+    return 1;
+}
+
+
+static int new_lua( lua_State *L )
+{
+    lua_Integer size = luaL_optinteger( L, 1, 0 );
+    pbuf_t *b = NULL;
+
+    luaL_argcheck( L, size >= 0, 1, "size must be greater than or equal to 0" );
+    b = lua_newuserdata( L, sizeof( pbuf_t ) );
+    *b = (pbuf_t){ NULL, 0, 0, 0 };
+    luaL_getmetatable( L, PROCESS_BUFFER_MT );
+    lua_setmetatable( L, -2 );
+
+    // preallocate
+    if( size && pbuf_reserve( b, (size_t)size ) == -1 ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+
+    return 1;
+}
+
+
+LUALIB_API int luaopen_process_buffer( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "len", len_lua },
+        { "read", read_lua },
+        { "peek", peek_lua },
+        { "reset", reset_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg *ptr = mmethod;
+
+    // create metatable
+    luaL_newmetatable( L, PROCESS_BUFFER_MT );
+    // metamethods
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    // methods
+    lua_pushstring( L, "__index" );
+    lua_newtable( L );
+    ptr = method;
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    lua_rawset( L, -3 );
+    lua_pop( L, 1 );
+
+    // push constructor
+    lua_pushcfunction( L, new_lua );
+
+    return 1;
+}
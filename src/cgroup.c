@@ -0,0 +1,285 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/cgroup.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+#include <sys/stat.h>
+
+
+#if defined(__linux__)
+
+static int cgroup_write( int dirfd, const char *name, const char *val,
+                         size_t len )
+{
+    int fd = openat( dirfd, name, O_WRONLY|O_CLOEXEC );
+    ssize_t rv = 0;
+    int err = 0;
+
+    if( fd == -1 ){
+        return -1;
+    }
+    while( ( rv = write( fd, val, len ) ) == -1 && errno == EINTR ){}
+    err = errno;
+    close( fd );
+    if( rv == -1 ){
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// read the contents of the file into buf as a null-terminated string
+static ssize_t cgroup_read( int dirfd, const char *name, char *buf,
+                            size_t size )
+{
+    int fd = openat( dirfd, name, O_RDONLY|O_CLOEXEC );
+    ssize_t len = 0;
+    ssize_t rv = 0;
+    int err = 0;
+
+    if( fd == -1 ){
+        return -1;
+    }
+    while( (size_t)len < size - 1 )
+    {
+        rv = read( fd, buf + len, size - 1 - (size_t)len );
+        if( rv > 0 ){
+            len += rv;
+        }
+        else if( rv == 0 || errno != EINTR ){
+            break;
+        }
+    }
+    err = errno;
+    close( fd );
+    if( rv == -1 ){
+        errno = err;
+        return -1;
+    }
+    buf[len] = 0;
+
+    return len;
+}
+
+
+// convert the value at the top of stack to the string for the interface file
+static inline const char *tolimit( lua_State *L, char *buf, size_t size,
+                                   size_t *len )
+{
+    if( lua_type( L, -1 ) == LUA_TNUMBER ){
+        *len = (size_t)snprintf( buf, size, "%lld",
+                                 (long long)lua_tointeger( L, -1 ) );
+        return buf;
+    }
+
+    return lua_tolstring( L, -1, len );
+}
+
+#endif
+
+
+int mkcgroup_lua( lua_State *L )
+{
+    const char *path = luaL_checkstring( L, 1 );
+#if defined(__linux__)
+    int created = 1;
+    int fd = -1;
+
+    // check the interface file names and values before creating the cgroup
+    if( !lua_isnoneornil( L, 2 ) )
+    {
+        luaL_checktype( L, 2, LUA_TTABLE );
+        lua_pushnil( L );
+        while( lua_next( L, 2 ) != 0 )
+        {
+            if( lua_type( L, -2 ) != LUA_TSTRING ||
+                strchr( lua_tostring( L, -2 ), '/' ) ||
+                ( lua_type( L, -1 ) != LUA_TSTRING &&
+                  lua_type( L, -1 ) != LUA_TNUMBER ) ){
+                luaL_argerror( L, 2, "limits must be pair table of "
+                               "interface file name and value" );
+            }
+            lua_pop( L, 1 );
+        }
+    }
+
+    if( mkdir( path, 0755 ) == -1 )
+    {
+        if( errno != EEXIST ){
+            goto FAILURE;
+        }
+        created = 0;
+    }
+    if( ( fd = open( path, O_RDONLY|O_DIRECTORY|O_CLOEXEC ) ) == -1 ){
+        goto REMOVE;
+    }
+
+    // write limits such as cpu.max and memory.max
+    if( !lua_isnoneornil( L, 2 ) )
+    {
+        char buf[32];
+        const char *val = NULL;
+        size_t len = 0;
+
+        lua_pushnil( L );
+        while( lua_next( L, 2 ) != 0 )
+        {
+            val = tolimit( L, buf, sizeof( buf ), &len );
+            if( cgroup_write( fd, lua_tostring( L, -2 ), val, len ) == -1 ){
+                int err = errno;
+
+                close( fd );
+                errno = err;
+                goto REMOVE;
+            }
+            lua_pop( L, 1 );
+        }
+    }
+    close( fd );
+
+    lua_pushboolean( L, 1 );
+    return 1;
+
+REMOVE:
+    if( created ){
+        int err = errno;
+
+        rmdir( path );
+        errno = err;
+    }
+
+FAILURE:
+#else
+    (void)path;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+int rmcgroup_lua( lua_State *L )
+{
+    const char *path = luaL_checkstring( L, 1 );
+
+#if defined(__linux__)
+    if( rmdir( path ) == 0 ){
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+#else
+    (void)path;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+int cgroupstat_lua( lua_State *L )
+{
+    const char *path = luaL_checkstring( L, 1 );
+#if defined(__linux__)
+    int fd = open( path, O_RDONLY|O_DIRECTORY|O_CLOEXEC );
+    char buf[4096];
+    char *ptr = NULL;
+    char *end = NULL;
+
+    if( fd == -1 ){
+        goto FAILURE;
+    }
+
+    lua_createtable( L, 0, 2 );
+    // cpu.stat consists of the lines of key and value that separated by
+    // space. only the usage fields are reported if the cpu controller is
+    // not enabled.
+    if( cgroup_read( fd, "cpu.stat", buf, sizeof( buf ) ) != -1 )
+    {
+        lua_pushstring( L, "cpu" );
+        lua_createtable( L, 0, 6 );
+        for( ptr = buf; ( end = strchr( ptr, '\n' ) ); ptr = end + 1 )
+        {
+            char *sep = memchr( ptr, ' ', (size_t)( end - ptr ) );
+
+            if( sep ){
+                lua_pushlstring( L, ptr, (size_t)( sep - ptr ) );
+                lua_pushinteger( L, (lua_Integer)strtoll( sep + 1, NULL, 10 ) );
+                lua_rawset( L, -3 );
+            }
+        }
+        lua_rawset( L, -3 );
+    }
+    else if( errno != ENOENT ){
+        goto CLOSE;
+    }
+
+    // memory.current is the total memory usage in bytes
+    if( cgroup_read( fd, "memory.current", buf, sizeof( buf ) ) != -1 )
+    {
+        lua_pushstring( L, "memory" );
+        lua_createtable( L, 0, 1 );
+        lua_pushstring( L, "current" );
+        lua_pushinteger( L, (lua_Integer)strtoll( buf, NULL, 10 ) );
+        lua_rawset( L, -3 );
+        lua_rawset( L, -3 );
+    }
+    else if( errno != ENOENT ){
+        goto CLOSE;
+    }
+    close( fd );
+
+    return 1;
+
+CLOSE: {
+        int err = errno;
+
+        close( fd );
+        errno = err;
+    }
+
+FAILURE:
+#else
+    (void)path;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
@@ -27,51 +27,319 @@
  */
 
 #include "lprocess.h"
+#include <limits.h>
+#include <poll.h>
 
 
-static int stdin_lua( lua_State *L )
+#if defined(IOV_MAX)
+#define PCHILD_IOV_MAX  IOV_MAX
+#else
+#define PCHILD_IOV_MAX  1024
+#endif
+
+// check data arguments; strings or an array table of strings
+static inline int checkiov( lua_State *L, struct iovec *iov, size_t *len )
+{
+    int argc = lua_gettop( L );
+    int cnt = 0;
+
+    *len = 0;
+    // array table
+    if( argc == 2 && lua_type( L, 2 ) == LUA_TTABLE )
+    {
+        int i = 1;
+
+        lua_rawgeti( L, 2, i );
+        while( !lua_isnil( L, -1 ) )
+        {
+            if( lua_type( L, -1 ) != LUA_TSTRING ){
+                luaL_argerror( L, 2, "data must be array of string" );
+            }
+            else if( cnt == PCHILD_IOV_MAX ){
+                luaL_argerror( L, 2, "too many data" );
+            }
+            // NOTE: value is still referenced from the table
+            iov[cnt].iov_base = (void*)lua_tolstring( L, -1, &iov[cnt].iov_len );
+            *len += iov[cnt++].iov_len;
+            lua_pop( L, 1 );
+            lua_rawgeti( L, 2, ++i );
+        }
+        lua_pop( L, 1 );
+    }
+    else
+    {
+        int i = 2;
+
+        luaL_checkany( L, 2 );
+        if( argc - 1 > PCHILD_IOV_MAX ){
+            luaL_argerror( L, PCHILD_IOV_MAX + 2, "too many data" );
+        }
+        for(; i <= argc; i++ ){
+            iov[cnt].iov_base = (void*)luaL_checklstring( L, i,
+                                                          &iov[cnt].iov_len );
+            *len += iov[cnt++].iov_len;
+        }
+    }
+
+    return cnt;
+}
+
+
+// skip the written bytes
+static inline int skipiov( struct iovec **iov, int cnt, size_t bytes )
+{
+    struct iovec *ptr = *iov;
+
+    while( cnt && bytes >= ptr->iov_len ){
+        bytes -= ptr->iov_len;
+        ptr++;
+        cnt--;
+    }
+    if( cnt ){
+        ptr->iov_base = (char*)ptr->iov_base + bytes;
+        ptr->iov_len -= bytes;
+    }
+    *iov = ptr;
+
+    return cnt;
+}
+
+
+#if defined(__linux__)
+
+// release the pinned strings whose data has been consumed by the child
+// process. the pipe holds the last FIONREAD bytes written to stdin, so the
+// data written before them is no longer referenced by the pipe.
+static inline void unpin( lua_State *L, pchild_t *chd )
+{
+    int nbyte = 0;
+    lua_Number consumed = 0;
+
+    if( chd->pinref == LUA_NOREF ||
+        ioctl( chd->fds[0], FIONREAD, &nbyte ) == -1 ){
+        return;
+    }
+
+    consumed = (lua_Number)( chd->nwritten - (uint64_t)nbyte );
+    lua_rawgeti( L, LUA_REGISTRYINDEX, chd->pinref );
+    while( chd->pinhead < chd->pintail )
+    {
+        // the first field of each entry is the end position of the data
+        lua_rawgeti( L, -1, chd->pinhead + 1 );
+        lua_rawgeti( L, -1, 1 );
+        if( lua_tonumber( L, -1 ) > consumed ){
+            lua_pop( L, 2 );
+            break;
+        }
+        lua_pop( L, 2 );
+        lua_pushnil( L );
+        lua_rawseti( L, -2, ++chd->pinhead );
+    }
+    lua_pop( L, 1 );
+
+    if( chd->pinhead == chd->pintail ){
+        luaL_unref( L, LUA_REGISTRYINDEX, chd->pinref );
+        chd->pinref = LUA_NOREF;
+        chd->pinhead = chd->pintail = 0;
+    }
+}
+
+
+// release the pinned strings when the instance is collected.
+// the strings that are still referenced by the pipe are kept in the registry
+// until the lua state is closed, unless the read end of the pipe has been
+// closed; the pipe is freed when stdin is closed in that case.
+static inline void unpin_all( lua_State *L, pchild_t *chd )
+{
+    struct pollfd pfd = {
+        .fd = chd->fds[0],
+        .events = POLLOUT,
+        .revents = 0
+    };
+
+    unpin( L, chd );
+    if( chd->pinref == LUA_NOREF ){
+        return;
+    }
+    // POLLERR is set to the write end if there is no reader
+    else if( chd->fds[0] != -1 && poll( &pfd, 1, 0 ) > 0 &&
+             ( pfd.revents & POLLERR ) ){
+        luaL_unref( L, LUA_REGISTRYINDEX, chd->pinref );
+        chd->pinref = LUA_NOREF;
+        chd->pinhead = chd->pintail = 0;
+        return;
+    }
+    // the reader may still read the pages
+    PSTATS.pinned += (uint64_t)( chd->pintail - chd->pinhead );
+}
+
+
+// keep the data strings until the child process consumes the data written
+// up to the current position of stdin
+static inline void pin( lua_State *L, pchild_t *chd )
+{
+    int argc = lua_gettop( L );
+    int n = 1;
+    int i = 2;
+
+    if( chd->pinref == LUA_NOREF ){
+        lua_newtable( L );
+        chd->pinref = luaL_ref( L, LUA_REGISTRYINDEX );
+    }
+    lua_rawgeti( L, LUA_REGISTRYINDEX, chd->pinref );
+    lua_newtable( L );
+    lua_pushnumber( L, (lua_Number)chd->nwritten );
+    lua_rawseti( L, -2, n );
+    for(; i <= argc; i++ )
+    {
+        // pin the strings of the array table instead of the table itself,
+        // because the table can be modified after the call
+        if( lua_type( L, i ) == LUA_TTABLE )
+        {
+            int j = 1;
+
+            lua_rawgeti( L, i, j );
+            while( !lua_isnil( L, -1 ) ){
+                lua_rawseti( L, -2, ++n );
+                lua_rawgeti( L, i, ++j );
+            }
+            lua_pop( L, 1 );
+        }
+        else {
+            lua_pushvalue( L, i );
+            lua_rawseti( L, -2, ++n );
+        }
+    }
+    lua_rawseti( L, -2, ++chd->pintail );
+    lua_pop( L, 1 );
+}
+
+#endif
+
+
+// the total length of the data is stored to *total if it is not NULL
+static inline int writev_lua( lua_State *L, int usevmsplice, size_t *total )
 {
     pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    struct iovec vec[PCHILD_IOV_MAX];
+    struct iovec *iov = vec;
     size_t len = 0;
-    const char *str = luaL_checklstring( L, 2, &len );
+    int cnt = checkiov( L, vec, &len );
     size_t remain = len;
-    char *ptr = (char*)str;
     ssize_t bytes = 0;
 
-    do
+    if( total ){
+        *total = len;
+    }
+
+#if defined(__linux__)
+    if( usevmsplice ){
+        unpin( L, chd );
+    }
+#endif
+
+    while( cnt )
     {
+#if defined(__linux__)
+        if( usevmsplice ){
+            bytes = vmsplice( chd->fds[0], iov, (unsigned long)cnt,
+                              chd->nonblock ? SPLICE_F_NONBLOCK : 0 );
+        }
+        else
+#endif
+        if( cnt == 1 ){
+            bytes = write( chd->fds[0], iov->iov_base, iov->iov_len );
+        }
+        else {
+            bytes = writev( chd->fds[0], iov, cnt );
+        }
+
         // got error
-        if( ( bytes = write( chd->fds[0], ptr, remain ) ) == -1 )
+        if( bytes == -1 )
         {
+            if( errno == EINTR ){
+                continue;
+            }
+#if defined(__linux__)
+            else if( usevmsplice && remain != len ){
+                pin( L, chd );
+            }
+#endif
             lua_pushinteger( L, remain );
             lua_pushstring( L, strerror( errno ) );
             // check non-blocking mode
-            if( errno == EAGAIN || errno == EWOULDBLOCK ){
+            if( pstats_again( errno ) ){
                 lua_pushboolean( L, 1 );
                 return 3;
             }
             return 2;
         }
-        // end-of-file or succeeded
-        else if( ( bytes == 0 && remain == 0 ) || ( remain -= bytes ) == 0 ){
-            break;
-        }
-        ptr += bytes;
+        remain -= (size_t)bytes;
+        chd->nwritten += (uint64_t)bytes;
+        PSTATS.written += (uint64_t)bytes;
+        cnt = skipiov( &iov, cnt, (size_t)bytes );
+    }
 
-    } while(1);
+#if defined(__linux__)
+    if( usevmsplice && len ){
+        pin( L, chd );
+    }
+#endif
 
     lua_pushinteger( L, len );
     return 1;
 }
 
 
+int pchild_write( lua_State *L, size_t *total )
+{
+    return writev_lua( L, 0, total );
+}
+
+
+static int stdin_lua( lua_State *L )
+{
+    return writev_lua( L, 0, NULL );
+}
+
+
+#if defined(__linux__)
+
+static int vmsplice_lua( lua_State *L )
+{
+    return writev_lua( L, 1, NULL );
+}
+
+#endif
+
+
+// count the bytes read and record the time of the first output byte
+static inline void markread( pchild_t *chd, size_t bytes )
+{
+    PSTATS.read += bytes;
+    if( !chd->timings.firstbyte ){
+        chd->timings.firstbyte = getnsec();
+    }
+}
+
+
 static inline int read_lua( lua_State *L, int type )
 {
     pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    prbuf_t *rb = chd->rbufs + type - 1;
     char buf[LUAL_BUFFERSIZE] = {0};
-    ssize_t bytes = read( chd->fds[type], &buf, LUAL_BUFFERSIZE );
+    ssize_t bytes = 0;
 
+    // return the data buffered by the framed readers first
+    if( pbuf_len( &rb->buf ) ){
+        lua_pushlstring( L, pbuf_data( &rb->buf ), pbuf_len( &rb->buf ) );
+        prbuf_consume( rb, pbuf_len( &rb->buf ) );
+        return 1;
+    }
+
+    bytes = read( chd->fds[type], &buf, LUAL_BUFFERSIZE );
     if( bytes > 0 ){
+        markread( chd, (size_t)bytes );
         lua_pushlstring( L, buf, bytes );
         return 1;
     }
@@ -85,7 +353,78 @@ static inline int read_lua( lua_State *L, int type )
     lua_pushnil( L );
     lua_pushstring( L, strerror( errno ) );
     // check non-blocking mode
-    if( errno == EAGAIN || errno == EWOULDBLOCK ){
+    if( pstats_again( errno ) ){
+        lua_pushboolean( L, 1 );
+        return 3;
+    }
+
+    return 2;
+}
+
+// stream names for the read methods
+static const char *const STREAM_NAMES[] = {
+    "stdout",
+    "stderr",
+    NULL
+};
+
+#define checkstream(L,idx)  (luaL_checkoption( L, idx, NULL, STREAM_NAMES ) + 1)
+
+
+static int readall_lua( lua_State *L )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    int type = checkstream( L, 2 );
+    int fd = chd->fds[type];
+    prbuf_t *rb = chd->rbufs + type - 1;
+    size_t buffered = pbuf_len( &rb->buf );
+    size_t total = 0;
+    ssize_t bytes = 0;
+    luaL_Buffer b;
+
+    luaL_buffinit( L, &b );
+    // take the data buffered by the framed readers first
+    if( buffered ){
+        luaL_addlstring( &b, pbuf_data( &rb->buf ), buffered );
+        prbuf_consume( rb, buffered );
+        total = buffered;
+    }
+    // read data until end-of-file
+    while( 1 )
+    {
+        char *buf = luaL_prepbuffer( &b );
+
+        if( ( bytes = read( fd, buf, LUAL_BUFFERSIZE ) ) > 0 ){
+            luaL_addsize( &b, (size_t)bytes );
+            total += (size_t)bytes;
+        }
+        // end-of-file
+        else if( bytes == 0 ){
+            break;
+        }
+        else if( errno != EINTR ){
+            break;
+        }
+    }
+
+    if( total ){
+        if( total > buffered ){
+            markread( chd, total - buffered );
+        }
+        luaL_pushresult( &b );
+        return 1;
+    }
+    // end-of-file
+    else if( bytes == 0 ){
+        lua_pushnil( L );
+        return 1;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+    // check non-blocking mode
+    if( pstats_again( errno ) ){
         lua_pushboolean( L, 1 );
         return 3;
     }
@@ -93,6 +432,305 @@ static inline int read_lua( lua_State *L, int type )
     return 2;
 }
 
+
+// read data up to n bytes by a single read(2) call. it does not wait for the
+// rest of data, so the caller is not blocked by the child process that waits
+// for the input after writing a part of data.
+static int readsize_lua( lua_State *L )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    int type = checkstream( L, 2 );
+    lua_Integer n = luaL_optinteger( L, 3, LUAL_BUFFERSIZE );
+    prbuf_t *rb = chd->rbufs + type - 1;
+    size_t len = 0;
+    ssize_t bytes = 0;
+
+    luaL_argcheck( L, n > 0, 3, "n must be greater than 0" );
+    // NOTE: the data is read into the read buffer of the framed readers to
+    // read n bytes at once without a temporary buffer, and the buffered data
+    // is returned first without reading.
+    if( !pbuf_len( &rb->buf ) )
+    {
+        while( ( bytes = pbuf_read( &rb->buf, chd->fds[type],
+                                    (size_t)n ) ) == -1 && errno == EINTR ){}
+        // end-of-file
+        if( bytes == 0 ){
+            lua_pushnil( L );
+            return 1;
+        }
+        else if( bytes == -1 ){
+            lua_pushnil( L );
+            lua_pushstring( L, strerror( errno ) );
+            // check non-blocking mode
+            if( pstats_again( errno ) ){
+                lua_pushboolean( L, 1 );
+                return 3;
+            }
+            return 2;
+        }
+        markread( chd, (size_t)bytes );
+    }
+
+    len = pbuf_len( &rb->buf );
+    if( len > (size_t)n ){
+        len = (size_t)n;
+    }
+    lua_pushlstring( L, pbuf_data( &rb->buf ), len );
+    prbuf_consume( rb, len );
+
+    return 1;
+}
+
+
+static int readinto_lua( lua_State *L )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    int type = checkstream( L, 2 );
+    int fd = chd->fds[type];
+    pbuf_t *b = luaL_checkudata( L, 3, PROCESS_BUFFER_MT );
+    lua_Integer n = luaL_optinteger( L, 4, 0 );
+    prbuf_t *rb = chd->rbufs + type - 1;
+    size_t buffered = pbuf_len( &rb->buf );
+    size_t total = 0;
+    ssize_t bytes = 0;
+
+    luaL_argcheck( L, n >= 0, 4, "n must be greater than or equal to 0" );
+    // move the data buffered by the framed readers first
+    if( buffered )
+    {
+        if( n && buffered > (size_t)n ){
+            buffered = (size_t)n;
+        }
+        if( pbuf_reserve( b, buffered ) == -1 ){
+            lua_pushnil( L );
+            lua_pushstring( L, strerror( errno ) );
+            return 2;
+        }
+        memcpy( b->mem + b->tail, pbuf_data( &rb->buf ), buffered );
+        b->tail += buffered;
+        prbuf_consume( rb, buffered );
+        total = buffered;
+    }
+    // read data up to n bytes by a single read(2) call, or until
+    // end-of-file if n is 0
+    while( !n || !total )
+    {
+        size_t len = n ? (size_t)n : LUAL_BUFFERSIZE;
+
+        if( ( bytes = pbuf_read( b, fd, len ) ) > 0 ){
+            total += (size_t)bytes;
+        }
+        else if( bytes == 0 || errno != EINTR ){
+            break;
+        }
+    }
+
+    if( total ){
+        if( total > buffered ){
+            markread( chd, total - buffered );
+        }
+        lua_pushinteger( L, (lua_Integer)total );
+        return 1;
+    }
+    // end-of-file
+    else if( bytes == 0 ){
+        lua_pushnil( L );
+        return 1;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+    // check non-blocking mode
+    if( pstats_again( errno ) ){
+        lua_pushboolean( L, 1 );
+        return 3;
+    }
+
+    return 2;
+}
+
+
+// MARK: framed readers
+// minimum number of bytes to be read into the read buffer at once
+#define RBUF_CHUNK  (1024 * 64)
+// default maximum length of a line or a frame payload
+#define RBUF_MAX    (1024 * 1024 * 16)
+
+// read data into the read buffer of the stream
+static inline ssize_t fillbuf( pchild_t *chd, int type, size_t size )
+{
+    ssize_t bytes = 0;
+
+    if( size < RBUF_CHUNK ){
+        size = RBUF_CHUNK;
+    }
+    while( ( bytes = pbuf_read( &chd->rbufs[type - 1].buf, chd->fds[type],
+                                size ) ) == -1 && errno == EINTR ){}
+    if( bytes > 0 ){
+        markread( chd, (size_t)bytes );
+    }
+
+    return bytes;
+}
+
+
+static inline int pushreaderror( lua_State *L )
+{
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+    // check non-blocking mode
+    if( pstats_again( errno ) ){
+        lua_pushboolean( L, 1 );
+        return 3;
+    }
+
+    return 2;
+}
+
+
+static int readline_lua( lua_State *L )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    int type = checkstream( L, 2 );
+    lua_Integer max = luaL_optinteger( L, 3, RBUF_MAX );
+    prbuf_t *rb = chd->rbufs + type - 1;
+    ssize_t bytes = 0;
+
+    luaL_argcheck( L, max > 0, 3, "max must be greater than 0" );
+    while( 1 )
+    {
+        size_t len = pbuf_len( &rb->buf );
+        char *head = pbuf_data( &rb->buf );
+
+        // search the newline in the data that has not been scanned yet
+        if( len > rb->scanned )
+        {
+            char *lf = memchr( head + rb->scanned, '\n', len - rb->scanned );
+
+            if( lf ){
+                if( (size_t)( lf - head ) > (size_t)max ){
+                    errno = EMSGSIZE;
+                    return pushreaderror( L );
+                }
+                // remove the newline
+                lua_pushlstring( L, head, (size_t)( lf - head ) );
+                prbuf_consume( rb, (size_t)( lf - head ) + 1 );
+                return 1;
+            }
+            rb->scanned = len;
+        }
+        // do not wait for the newline of the line that exceeds max
+        if( len > (size_t)max ){
+            errno = EMSGSIZE;
+            return pushreaderror( L );
+        }
+
+        if( ( bytes = fillbuf( chd, type, 0 ) ) == -1 ){
+            return pushreaderror( L );
+        }
+        // end-of-file
+        else if( bytes == 0 )
+        {
+            // last line without newline
+            // NOTE: the buffer may have been reallocated by fillbuf
+            if( len ){
+                lua_pushlstring( L, pbuf_data( &rb->buf ), len );
+                prbuf_consume( rb, len );
+            }
+            else {
+                lua_pushnil( L );
+            }
+            return 1;
+        }
+    }
+}
+
+
+// formats of the length prefix of frame
+static const char *const FRAME_FORMATS[] = {
+    "u8",
+    "u16be",
+    "u16le",
+    "u32be",
+    "u32le",
+    NULL
+};
+
+
+static inline size_t framelen( const unsigned char *p, int fmt )
+{
+    switch( fmt ){
+        case 0:
+            return p[0];
+        case 1:
+            return (size_t)p[0] << 8 | p[1];
+        case 2:
+            return (size_t)p[1] << 8 | p[0];
+        case 3:
+            return (size_t)p[0] << 24 | (size_t)p[1] << 16 |
+                   (size_t)p[2] << 8 | p[3];
+        default:
+            return (size_t)p[3] << 24 | (size_t)p[2] << 16 |
+                   (size_t)p[1] << 8 | p[0];
+    }
+}
+
+
+static int readframe_lua( lua_State *L )
+{
+    static const size_t prefix[] = { 1, 2, 2, 4, 4 };
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    int type = checkstream( L, 2 );
+    int fmt = luaL_checkoption( L, 3, NULL, FRAME_FORMATS );
+    lua_Integer max = luaL_optinteger( L, 4, RBUF_MAX );
+    prbuf_t *rb = chd->rbufs + type - 1;
+    size_t plen = prefix[fmt];
+    ssize_t bytes = 0;
+
+    luaL_argcheck( L, max > 0, 4, "max must be greater than 0" );
+    while( 1 )
+    {
+        size_t len = pbuf_len( &rb->buf );
+        size_t need = plen;
+
+        if( len >= plen )
+        {
+            const unsigned char *head = (unsigned char*)pbuf_data( &rb->buf );
+            size_t flen = framelen( head, fmt );
+
+            if( flen > (size_t)max ){
+                errno = EMSGSIZE;
+                return pushreaderror( L );
+            }
+            // push the payload without the length prefix
+            else if( len - plen >= flen ){
+                lua_pushlstring( L, (const char*)head + plen, flen );
+                prbuf_consume( rb, plen + flen );
+                return 1;
+            }
+            need += flen;
+        }
+
+        // reserve the space for the rest of the frame at once
+        if( ( bytes = fillbuf( chd, type, need - len ) ) == -1 ){
+            return pushreaderror( L );
+        }
+        // end-of-file
+        else if( bytes == 0 )
+        {
+            if( len ){
+                // stream ended in the middle of the frame
+                errno = EPROTO;
+                return pushreaderror( L );
+            }
+            lua_pushnil( L );
+            return 1;
+        }
+    }
+}
+
+
 static int stderr_lua( lua_State *L )
 {
     return read_lua( L, 2 );
@@ -104,11 +742,107 @@ static int stdout_lua( lua_State *L )
 }
 
 
+#if defined(__linux__)
+// default number of bytes to be moved by a splice(2) call
+#define SPLICE_CHUNK    (1024 * 64 * 16)
+
+static inline int splice_lua( lua_State *L, int type )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    int fd = (int)luaL_checkinteger( L, 2 );
+    // move all data until end-of-file if len is not specified
+    int all = lua_isnoneornil( L, 3 );
+    lua_Integer len = all ? SPLICE_CHUNK : luaL_checkinteger( L, 3 );
+    unsigned int flg = SPLICE_F_MOVE|( chd->nonblock ? SPLICE_F_NONBLOCK : 0 );
+    // stdin: fd -> child, stdout/stderr: child -> fd
+    int in = type ? chd->fds[type] : fd;
+    int out = type ? fd : chd->fds[0];
+    lua_Integer total = 0;
+    ssize_t bytes = 0;
+
+    luaL_argcheck( L, len > 0, 3, "len must be greater than 0" );
+    do
+    {
+        bytes = splice( in, NULL, out, NULL, (size_t)len, flg );
+        // end-of-file
+        if( bytes == 0 ){
+            break;
+        }
+        else if( bytes == -1 )
+        {
+            if( errno == EINTR ){
+                continue;
+            }
+            // return number of bytes moved before the error
+            else if( total ){
+                break;
+            }
+
+            // got error
+            lua_pushnil( L );
+            lua_pushstring( L, strerror( errno ) );
+            // check non-blocking mode
+            if( pstats_again( errno ) ){
+                lua_pushboolean( L, 1 );
+                return 3;
+            }
+            return 2;
+        }
+        total += bytes;
+    } while( all );
+
+    if( !type ){
+        chd->nwritten += (uint64_t)total;
+        PSTATS.written += (uint64_t)total;
+    }
+    else if( total ){
+        markread( chd, (size_t)total );
+    }
+    lua_pushinteger( L, total );
+
+    return 1;
+}
+
+
+static int splice_stdin_lua( lua_State *L )
+{
+    return splice_lua( L, 0 );
+}
+
+
+static int splice_stdout_lua( lua_State *L )
+{
+    return splice_lua( L, 1 );
+}
+
+
+static int splice_stderr_lua( lua_State *L )
+{
+    return splice_lua( L, 2 );
+}
+
+#endif
+
+
 static int kill_lua( lua_State *L )
 {
     pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
     int signo = (int)luaL_optinteger( L, 2, SIGTERM );
-    int rc = kill( chd->pid, signo );
+    int rc = 0;
+
+    // the pid may already be recycled
+    if( chd->reaped ){
+        errno = ESRCH;
+        rc = -1;
+    }
+#if defined(__linux__) && defined(SYS_pidfd_send_signal)
+    else if( chd->pidfd != -1 ){
+        rc = (int)syscall( SYS_pidfd_send_signal, chd->pidfd, signo, NULL, 0 );
+    }
+#endif
+    else {
+        rc = kill( chd->pid, signo );
+    }
 
     if( rc == 0 ){
         return 0;
@@ -121,14 +855,206 @@ static int kill_lua( lua_State *L )
 }
 
 
+// MARK: wait
+#define WAIT_INTERVAL_NSEC  1000000
+
+// wait for the child to exit without a process descriptor
+static inline pid_t waitpoll( pchild_t *chd, int *rc, lua_Integer msec )
+{
+    struct timespec ts = { 0, WAIT_INTERVAL_NSEC };
+    pid_t rpid = 0;
+
+    while( ( rpid = wait4( chd->pid, rc, WNOHANG, &chd->rusage ) ) == 0 &&
+           msec > 0 ){
+        nanosleep( &ts, NULL );
+        msec--;
+    }
+
+    return rpid;
+}
+
+
+static int wait_lua( lua_State *L )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    lua_Integer msec = luaL_optinteger( L, 2, -1 );
+    int rusage = lauxh_optboolean( L, 3, 0 );
+    pid_t rpid = 0;
+    int rc = 0;
+
+    // already collected
+    if( chd->reaped > 0 ){
+        goto REAPED;
+    }
+    else if( chd->reaped < 0 ){
+        goto NOCHILD;
+    }
+    // wait until the child exits
+    else if( msec < 0 ){
+        rpid = wait4( chd->pid, &rc, 0, &chd->rusage );
+    }
+    else if( chd->pidfd != -1 )
+    {
+        struct pollfd pfd = {
+            .fd = chd->pidfd,
+            .events = POLLIN,
+            .revents = 0
+        };
+
+        switch( poll( &pfd, 1, msec > INT_MAX ? INT_MAX : (int)msec ) ){
+            // got error
+            case -1:
+                rpid = -1;
+            break;
+            // timed out
+            case 0:
+            break;
+            // the child has exited
+            default:
+                rpid = wait4( chd->pid, &rc, WNOHANG, &chd->rusage );
+        }
+    }
+    else {
+        rpid = waitpoll( chd, &rc, msec );
+    }
+
+    // timed out
+    if( rpid == 0 ){
+        lua_pushnil( L );
+        return 1;
+    }
+    else if( rpid != -1 ){
+        chd->reaped = 1;
+        chd->status = rc;
+        chd->timings.exit = getnsec();
+        PSTATS.reaped++;
+REAPED:
+        pushwaitstatus( L, chd->pid, chd->status );
+        if( rusage ){
+            lua_pushstring( L, "rusage" );
+            pushrusage( L, &chd->rusage );
+            lua_rawset( L, -3 );
+        }
+        return 1;
+    }
+    // already collected by someone else
+    else if( errno == ECHILD ){
+        chd->reaped = -1;
+NOCHILD:
+        lua_createtable( L, 0, 2 );
+        lauxh_pushnum2tbl( L, "pid", chd->pid );
+        lauxh_pushbool2tbl( L, "nochild", 1 );
+        return 1;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int timings_lua( lua_State *L )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    const char *names[] = {
+        "start", "fork", "setup", "exec", "spawned", "firstbyte", "exit"
+    };
+    uint64_t stamps[] = {
+        chd->timings.start, chd->timings.fork, chd->timings.setup,
+        chd->timings.exec, chd->timings.spawned, chd->timings.firstbyte,
+        chd->timings.exit
+    };
+    size_t i = 0;
+
+    // use the passed table
+    if( lua_type( L, 2 ) == LUA_TTABLE ){
+        lua_settop( L, 2 );
+    }
+    else {
+        lua_createtable( L, 0, 7 );
+    }
+    for(; i < sizeof( stamps ) / sizeof( uint64_t ); i++ )
+    {
+        lua_pushstring( L, names[i] );
+        // not recorded
+        if( !stamps[i] ){
+            lua_pushnil( L );
+        }
+        else {
+            lua_pushinteger( L, (lua_Integer)stamps[i] );
+        }
+        lua_rawset( L, -3 );
+    }
+
+    return 1;
+}
+
+
+static int pidfd_lua( lua_State *L )
+{
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+
+    // not supported
+    if( chd->pidfd == -1 ){
+        lua_pushnil( L );
+    }
+    else {
+        lua_pushinteger( L, chd->pidfd );
+    }
+
+    return 1;
+}
+
+
+static int pipesize_lua( lua_State *L )
+{
+    static const char *const names[] = {
+        "stdin",
+        "stdout",
+        "stderr",
+        NULL
+    };
+    pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
+    int fd = chd->fds[luaL_checkoption( L, 2, "stdout", names )];
+#if defined(__linux__)
+    int size = fcntl( fd, F_GETPIPE_SZ );
+
+    if( size != -1 ){
+        lua_pushinteger( L, size );
+        return 1;
+    }
+#else
+    (void)fd;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
 static int fds_lua( lua_State *L )
 {
     pchild_t *chd = luaL_checkudata( L, 1, PROCESS_CHILD_MT );
 
+    int i = 0;
+
     // return stdin, stdout and stderr descriptors
-    lua_pushinteger( L, chd->fds[0] );
-    lua_pushinteger( L, chd->fds[1] );
-    lua_pushinteger( L, chd->fds[2] );
+    for(; i < 3; i++ )
+    {
+        // not redirected to pipe
+        if( chd->fds[i] == -1 ){
+            lua_pushnil( L );
+        }
+        else {
+            lua_pushinteger( L, chd->fds[i] );
+        }
+    }
 
     return 3;
 }
@@ -149,13 +1075,24 @@ static int gc_lua( lua_State *L )
     pchild_t *chd = lua_touserdata( L, 1 );
     int i = 0;
 
+    PSTATS.live--;
+#if defined(__linux__)
+    // NOTE: must be called before closing stdin
+    unpin_all( L, chd );
+#endif
     for(; i < 3; i++ )
     {
-        if( chd->fds[i] ){
+        if( chd->fds[i] != -1 ){
             close( chd->fds[i] );
-            chd->fds[i] = 0;
+            chd->fds[i] = -1;
         }
     }
+    if( chd->pidfd != -1 ){
+        close( chd->pidfd );
+        chd->pidfd = -1;
+    }
+    pbuf_dispose( &chd->rbufs[0].buf );
+    pbuf_dispose( &chd->rbufs[1].buf );
 
     return 0;
 }
@@ -179,9 +1116,24 @@ LUALIB_API int luaopen_process_child( lua_State *L )
         { "pid", pid_lua },
         { "fds", fds_lua },
         { "kill", kill_lua },
+        { "wait", wait_lua },
+        { "pidfd", pidfd_lua },
+        { "timings", timings_lua },
+        { "pipesize", pipesize_lua },
         { "stdin", stdin_lua },
         { "stdout", stdout_lua },
         { "stderr", stderr_lua },
+        { "read", readsize_lua },
+        { "readall", readall_lua },
+        { "readinto", readinto_lua },
+        { "readline", readline_lua },
+        { "readframe", readframe_lua },
+#if defined(__linux__)
+        { "vmsplice", vmsplice_lua },
+        { "splice_stdin", splice_stdin_lua },
+        { "splice_stdout", splice_stdout_lua },
+        { "splice_stderr", splice_stderr_lua },
+#endif
         { NULL, NULL }
     };
     struct luaL_Reg *ptr = mmethod;
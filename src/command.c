@@ -0,0 +1,194 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/command.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+
+
+static int spawn_lua( lua_State *L )
+{
+    pcmd_t *cmd = luaL_checkudata( L, 1, PROCESS_COMMAND_MT );
+    ptimings_t t = { .start = getnsec() };
+    iopipe_t iop = iop_no_value;
+    pcmd_t extra = *cmd;
+    char **argv = NULL;
+    pid_t pid = -1;
+
+    // append the extra arguments to argv
+    if( !lua_isnoneornil( L, 2 ) )
+    {
+        size_t argc = 0;
+
+        luaL_checktype( L, 2, LUA_TTABLE );
+        lua_settop( L, 2 );
+        lua_rawgeti( L, 2, (int)argc + 1 );
+        while( !lua_isnil( L, -1 ) )
+        {
+            switch( lua_type( L, -1 ) ){
+                case LUA_TSTRING:
+                case LUA_TNUMBER:
+                    lua_pop( L, 1 );
+                    lua_rawgeti( L, 2, (int)++argc + 1 );
+                break;
+                default:
+                    return luaL_argerror( L, 2, "args must be array of string" );
+            }
+        }
+        lua_pop( L, 1 );
+
+        if( argc )
+        {
+            size_t i = 0;
+
+            luaL_checkstack( L, (int)argc, "too many arguments" );
+            if( !( argv = malloc( sizeof( char* ) * ( cmd->argc + argc + 1 ) ) ) ){
+                lua_pushnil( L );
+                lua_pushstring( L, strerror( errno ) );
+                return 2;
+            }
+            memcpy( argv, cmd->argv, sizeof( char* ) * cmd->argc );
+            // the strings are retained on the stack until returning since
+            // numbers are converted to new strings
+            for(; i < argc; i++ ){
+                lua_rawgeti( L, 2, (int)i + 1 );
+                argv[cmd->argc + i] = (char*)lua_tostring( L, -1 );
+            }
+            argv[cmd->argc + argc] = NULL;
+            extra.argc = cmd->argc + argc;
+            extra.argv = argv;
+        }
+    }
+
+    pid = pcmd_spawn( &extra, &iop, &t );
+    if( argv ){
+        int err = errno;
+
+        free( (void*)argv );
+        errno = err;
+    }
+
+    if( pid != -1 ){
+        newpchild( L, pid, iop.fds[IOP_IN_WRITE], iop.fds[IOP_OUT_READ],
+                   iop.fds[IOP_ERR_READ], cmd->nonblock, &t );
+        return 1;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int argv_lua( lua_State *L )
+{
+    pcmd_t *cmd = luaL_checkudata( L, 1, PROCESS_COMMAND_MT );
+    size_t i = 0;
+
+    lua_createtable( L, (int)cmd->argc, 0 );
+    for(; i < cmd->argc; i++ ){
+        lua_pushstring( L, cmd->argv[i] );
+        lua_rawseti( L, -2, (int)i + 1 );
+    }
+
+    return 1;
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    pcmd_dispose( lua_touserdata( L, 1 ) );
+
+    return 0;
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    lua_pushfstring( L, PROCESS_COMMAND_MT ": %p", lua_touserdata( L, 1 ) );
+    return 1;
+}
+
+
+static int new_lua( lua_State *L )
+{
+    pcmd_t *cmd = lua_newuserdata( L, sizeof( pcmd_t ) );
+
+    memset( (void*)cmd, 0, sizeof( pcmd_t ) );
+    luaL_getmetatable( L, PROCESS_COMMAND_MT );
+    lua_setmetatable( L, -2 );
+
+    if( pcmd_init( L, cmd, 1 ) == 0 ){
+        return 1;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+LUALIB_API int luaopen_process_command( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "spawn", spawn_lua },
+        { "argv", argv_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg *ptr = mmethod;
+
+    // create metatable
+    luaL_newmetatable( L, PROCESS_COMMAND_MT );
+    // metamethods
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    // methods
+    lua_pushstring( L, "__index" );
+    lua_newtable( L );
+    ptr = method;
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    lua_rawset( L, -3 );
+    lua_pop( L, 1 );
+
+    // push constructor
+    lua_pushcfunction( L, new_lua );
+
+    return 1;
+}
@@ -0,0 +1,622 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/forkserver.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+#include <sys/socket.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+
+// maximum size of a request message
+#define FS_MSG_MAX  (1024 * 128)
+
+
+typedef struct {
+    int sock;
+    pid_t pid;
+} pforkserver_t;
+
+
+// request message header that followed by the strings;
+// path, argv[1..], env[...], cwd, cgroup and paths of stdio files
+typedef struct {
+    uint32_t argc;
+    // -1: inherit the environment of the server
+    int32_t envc;
+    int32_t haspwd;
+    int32_t hascgroup;
+    int32_t nonblock;
+    int32_t pipesize;
+    struct {
+        int32_t type;
+        int32_t flags;
+        uint32_t mode;
+    } stdio[3];
+    pattr_t attr;
+    uint32_t len;
+} fsreq_t;
+
+
+typedef struct {
+    int32_t pid;
+    int32_t err;
+    // process id of the child process that failed to execute the file
+    int32_t zombie;
+    // timestamps of the spawn phases that recorded by the server
+    ptimings_t timings;
+} fsres_t;
+
+
+static ssize_t sendfds( int sock, void *data, size_t len, int *fds, int nfd )
+{
+    char cbuf[CMSG_SPACE( sizeof( int ) * 3 )];
+    struct iovec iov = {
+        .iov_base = data,
+        .iov_len = len
+    };
+    struct msghdr msg = {
+        .msg_name = NULL,
+        .msg_namelen = 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = NULL,
+        .msg_controllen = 0,
+        .msg_flags = 0
+    };
+    ssize_t rv = 0;
+
+    if( nfd )
+    {
+        struct cmsghdr *cmsg = NULL;
+
+        memset( cbuf, 0, sizeof( cbuf ) );
+        msg.msg_control = cbuf;
+        msg.msg_controllen = CMSG_SPACE( sizeof( int ) * (size_t)nfd );
+        cmsg = CMSG_FIRSTHDR( &msg );
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN( sizeof( int ) * (size_t)nfd );
+        memcpy( CMSG_DATA( cmsg ), fds, sizeof( int ) * (size_t)nfd );
+    }
+
+    while( ( rv = sendmsg( sock, &msg, MSG_NOSIGNAL ) ) == -1 &&
+           errno == EINTR ){}
+
+    return rv;
+}
+
+
+static ssize_t recvfds( int sock, void *data, size_t len, int *fds, int *nfd )
+{
+    char cbuf[CMSG_SPACE( sizeof( int ) * 3 )];
+    struct iovec iov = {
+        .iov_base = data,
+        .iov_len = len
+    };
+    struct msghdr msg = {
+        .msg_name = NULL,
+        .msg_namelen = 0,
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = cbuf,
+        .msg_controllen = sizeof( cbuf ),
+        .msg_flags = 0
+    };
+    struct cmsghdr *cmsg = NULL;
+    ssize_t rv = 0;
+
+    *nfd = 0;
+    while( ( rv = recvmsg( sock, &msg, MSG_CMSG_CLOEXEC ) ) == -1 &&
+           errno == EINTR ){}
+
+    if( rv > 0 )
+    {
+        for( cmsg = CMSG_FIRSTHDR( &msg ); cmsg;
+             cmsg = CMSG_NXTHDR( &msg, cmsg ) )
+        {
+            if( cmsg->cmsg_level == SOL_SOCKET &&
+                cmsg->cmsg_type == SCM_RIGHTS ){
+                *nfd = (int)( ( cmsg->cmsg_len - CMSG_LEN( 0 ) ) /
+                              sizeof( int ) );
+                memcpy( fds, CMSG_DATA( cmsg ), sizeof( int ) * (size_t)*nfd );
+            }
+        }
+    }
+
+    return rv;
+}
+
+
+// MARK: server
+static void closefds( int sock )
+{
+    int maxfd = (int)sysconf( _SC_OPEN_MAX );
+    int fd = STDERR_FILENO + 1;
+
+#if defined(SYS_close_range)
+    if( sock > fd ){
+        syscall( SYS_close_range, fd, sock - 1, 0 );
+    }
+    if( syscall( SYS_close_range, sock + 1, ~0U, 0 ) == 0 ){
+        return;
+    }
+#endif
+    for(; fd < maxfd; fd++ )
+    {
+        if( fd != sock ){
+            close( fd );
+        }
+    }
+}
+
+
+// unpack the request and spawn the child process
+static void spawn( fsreq_t *req, char *tail, int *fds, int nfd,
+                   iopipe_t *iop, fsres_t *res )
+{
+    char *argv[req->argc + 1];
+    char *envp[req->envc > 0 ? req->envc + 1 : 1];
+    pstdio_t stdio[3];
+    pspawn_t ps = {
+        .path = NULL,
+        .argv = argv,
+        .envp = req->envc < 0 ? NULL : envp,
+        .pwd = NULL,
+        .iop = iop,
+        .usefork = 1,
+        .sibling = 1,
+        .timings = &res->timings,
+        .attr = &req->attr,
+        .cgroup = NULL
+    };
+    char *str = (char*)( req + 1 );
+    int ifd = 0;
+    uint32_t i = 0;
+
+#define unpack_str(dest) do {                               \
+    size_t slen = strnlen( str, (size_t)( tail - str ) );   \
+    if( str + slen >= tail ){                               \
+        return;                                             \
+    }                                                       \
+    dest = str;                                             \
+    str += slen + 1;                                        \
+}while(0)
+
+    for(; i < req->argc; i++ ){
+        unpack_str( argv[i] );
+    }
+    argv[i] = NULL;
+    ps.path = argv[0];
+    for( i = 0; req->envc > 0 && i < (uint32_t)req->envc; i++ ){
+        unpack_str( envp[i] );
+    }
+    envp[i] = NULL;
+    if( req->haspwd ){
+        unpack_str( ps.pwd );
+    }
+    if( req->hascgroup ){
+        unpack_str( ps.cgroup );
+    }
+    for( i = 0; i < 3; i++ )
+    {
+        stdio[i] = pstdio_pipe;
+        stdio[i].type = (pstdio_e)req->stdio[i].type;
+        stdio[i].flags = req->stdio[i].flags;
+        stdio[i].mode = (mode_t)req->stdio[i].mode;
+        if( stdio[i].type == PSTDIO_FILE ){
+            unpack_str( stdio[i].path );
+        }
+        // descriptors are passed in order of streams
+        else if( stdio[i].type == PSTDIO_FD ){
+            if( ifd == nfd ){
+                return;
+            }
+            stdio[i].fd = fds[ifd++];
+        }
+    }
+
+#undef unpack_str
+
+    if( iop_init( iop, stdio ) == -1 ||
+        ( req->nonblock && iop_setnonblock( iop ) == -1 ) ||
+        ( req->pipesize && iop_setpipesize( iop, req->pipesize ) == -1 ) ){
+        res->err = errno;
+    }
+    else if( ( res->pid = pspawn( &ps ) ) == -1 ){
+        res->err = errno;
+        res->zombie = ps.zombie;
+    }
+    else {
+        res->err = 0;
+        iop_unset( iop );
+    }
+}
+
+
+static void serve( int sock, char *buf )
+{
+    fsreq_t *req = (fsreq_t*)buf;
+    int fds[3];
+    int nfd = 0;
+    ssize_t len = 0;
+
+    while( ( len = recvfds( sock, buf, FS_MSG_MAX, fds, &nfd ) ) > 0 )
+    {
+        iopipe_t iop = iop_no_value;
+        fsres_t res = { .pid = -1, .err = EINVAL, .zombie = 0 };
+        int pfds[3];
+        int npfd = 0;
+        int i = 0;
+
+        // each string has at least one byte
+        if( (size_t)len > sizeof( fsreq_t ) && req->argc &&
+            req->argc <= (size_t)len && req->envc <= (int32_t)len )
+        {
+            spawn( req, buf + len, fds, nfd, &iop, &res );
+            if( !res.err )
+            {
+                for(; i < 3; i++ )
+                {
+                    if( iop.fds[iop_parent_idx( i )] != -1 ){
+                        pfds[npfd++] = iop.fds[iop_parent_idx( i )];
+                    }
+                }
+            }
+        }
+
+        for( i = 0; i < nfd; i++ ){
+            close( fds[i] );
+        }
+        if( sendfds( sock, &res, sizeof( fsres_t ), pfds, npfd ) == -1 ){
+            break;
+        }
+        iop_dispose( &iop );
+    }
+}
+
+
+static int spawnserver( pforkserver_t *fs )
+{
+    int sv[2];
+    int bufsiz = FS_MSG_MAX;
+
+    if( socketpair( AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0, sv ) == -1 ){
+        return -1;
+    }
+    setsockopt( sv[0], SOL_SOCKET, SO_SNDBUF, &bufsiz, sizeof( int ) );
+
+    fs->pid = fork();
+    // server
+    if( fs->pid == 0 )
+    {
+        char *buf = malloc( FS_MSG_MAX );
+        sigset_t mask;
+        int signo = 1;
+
+        // reset signal handlers and mask
+        for(; signo < NSIG; signo++ ){
+            signal( signo, SIG_DFL );
+        }
+        sigemptyset( &mask );
+        sigprocmask( SIG_SETMASK, &mask, NULL );
+        close( sv[0] );
+        closefds( sv[1] );
+        if( buf ){
+            serve( sv[1], buf );
+        }
+        _exit(0);
+    }
+
+    close( sv[1] );
+    if( fs->pid == -1 ){
+        int err = errno;
+
+        close( sv[0] );
+        errno = err;
+        return -1;
+    }
+    fs->sock = sv[0];
+
+    return 0;
+}
+
+
+// MARK: client
+static inline void packstr( char **ptr, const char *str )
+{
+    size_t len = strlen( str ) + 1;
+
+    memcpy( *ptr, str, len );
+    *ptr += len;
+}
+
+
+static int exec_lua( lua_State *L )
+{
+    pforkserver_t *fs = luaL_checkudata( L, 1, PROCESS_FORKSERVER_MT );
+    uint64_t start = getnsec();
+    pcmd_t cmd;
+    fsreq_t *req = NULL;
+    fsres_t res;
+    char *buf = NULL;
+    char *ptr = NULL;
+    size_t len = sizeof( fsreq_t );
+    int fds[3];
+    int nfd = 0;
+    int i = 0;
+    char **arr = NULL;
+    ssize_t rv = 0;
+
+    if( fs->sock == -1 ){
+        errno = EBADF;
+        goto FAILURE;
+    }
+    else if( pcmd_init( L, &cmd, 2 ) == -1 ){
+        goto FAILURE;
+    }
+
+    // calculate the size of message
+    for( arr = cmd.argv; *arr; arr++ ){
+        len += strlen( *arr ) + 1;
+    }
+    for( arr = cmd.envp; arr && *arr; arr++ ){
+        len += strlen( *arr ) + 1;
+    }
+    if( cmd.pwd ){
+        len += strlen( cmd.pwd ) + 1;
+    }
+    if( cmd.cgroup ){
+        len += strlen( cmd.cgroup ) + 1;
+    }
+    for(; i < 3; i++ )
+    {
+        if( cmd.stdio[i].type == PSTDIO_FILE ){
+            len += strlen( cmd.stdio[i].path ) + 1;
+        }
+        else if( cmd.stdio[i].type == PSTDIO_FD ){
+            fds[nfd++] = cmd.stdio[i].fd;
+        }
+    }
+
+    if( len > FS_MSG_MAX ){
+        pcmd_dispose( &cmd );
+        errno = E2BIG;
+        goto FAILURE;
+    }
+    else if( !( buf = malloc( len ) ) ){
+        pcmd_dispose( &cmd );
+        goto FAILURE;
+    }
+
+    // pack request
+    req = (fsreq_t*)buf;
+    *req = (fsreq_t){
+        .argc = 0,
+        .envc = cmd.envp ? 0 : -1,
+        .haspwd = cmd.pwd != NULL,
+        .hascgroup = cmd.cgroup != NULL,
+        .nonblock = cmd.nonblock,
+        .pipesize = cmd.pipesize,
+        .attr = cmd.attr,
+        .len = (uint32_t)( len - sizeof( fsreq_t ) )
+    };
+    ptr = buf + sizeof( fsreq_t );
+    for( arr = cmd.argv; *arr; arr++ ){
+        packstr( &ptr, *arr );
+        req->argc++;
+    }
+    for( arr = cmd.envp; arr && *arr; arr++ ){
+        packstr( &ptr, *arr );
+        req->envc++;
+    }
+    if( cmd.pwd ){
+        packstr( &ptr, cmd.pwd );
+    }
+    if( cmd.cgroup ){
+        packstr( &ptr, cmd.cgroup );
+    }
+    for( i = 0; i < 3; i++ )
+    {
+        req->stdio[i].type = (int32_t)cmd.stdio[i].type;
+        req->stdio[i].flags = cmd.stdio[i].flags;
+        req->stdio[i].mode = (uint32_t)cmd.stdio[i].mode;
+        if( cmd.stdio[i].type == PSTDIO_FILE ){
+            packstr( &ptr, cmd.stdio[i].path );
+        }
+    }
+    pcmd_dispose( &cmd );
+
+    // send request and receive response
+    rv = sendfds( fs->sock, buf, len, fds, nfd );
+    free( (void*)buf );
+    if( rv == -1 ){
+        goto FAILURE;
+    }
+    else if( ( rv = recvfds( fs->sock, &res, sizeof( fsres_t ), fds,
+                             &nfd ) ) != sizeof( fsres_t ) ){
+        for( i = 0; i < nfd; i++ ){
+            close( fds[i] );
+        }
+        // server has been exited
+        if( rv != -1 ){
+            errno = EPIPE;
+        }
+        goto FAILURE;
+    }
+    // got error
+    else if( res.err ){
+        // child process is a child of the calling process
+        if( res.zombie > 0 ){
+            waitpid( res.zombie, NULL, 0 );
+        }
+        errno = res.err;
+        goto FAILURE;
+    }
+
+    // descriptors are passed in order of streams
+    {
+        int pfds[3] = { -1, -1, -1 };
+        int ifd = 0;
+
+        for( i = 0; i < 3; i++ )
+        {
+            if( cmd.stdio[i].type == PSTDIO_PIPE && ifd < nfd ){
+                pfds[i] = fds[ifd++];
+            }
+        }
+        // monotonic clock is shared with the server
+        res.timings.start = start;
+        newpchild( L, res.pid, pfds[0], pfds[1], pfds[2], cmd.nonblock,
+                   &res.timings );
+    }
+    PSTATS.spawn++;
+
+    return 1;
+
+FAILURE:
+    PSTATS.spawn++;
+    PSTATS.spawnfail++;
+    pstats_error( errno );
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int pid_lua( lua_State *L )
+{
+    pforkserver_t *fs = luaL_checkudata( L, 1, PROCESS_FORKSERVER_MT );
+
+    lua_pushinteger( L, fs->pid );
+
+    return 1;
+}
+
+
+static void close_server( pforkserver_t *fs )
+{
+    if( fs->sock != -1 ){
+        // server exits when the socket is closed
+        close( fs->sock );
+        fs->sock = -1;
+        waitpid( fs->pid, NULL, 0 );
+    }
+}
+
+
+static int close_lua( lua_State *L )
+{
+    close_server( luaL_checkudata( L, 1, PROCESS_FORKSERVER_MT ) );
+
+    return 0;
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    close_server( lua_touserdata( L, 1 ) );
+
+    return 0;
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    lua_pushfstring( L, PROCESS_FORKSERVER_MT ": %p", lua_touserdata( L, 1 ) );
+    return 1;
+}
+
+
+static int new_lua( lua_State *L )
+{
+#if defined(__linux__)
+    pforkserver_t *fs = lua_newuserdata( L, sizeof( pforkserver_t ) );
+
+    *fs = (pforkserver_t){
+        .sock = -1,
+        .pid = -1
+    };
+    if( spawnserver( fs ) == 0 ){
+        luaL_getmetatable( L, PROCESS_FORKSERVER_MT );
+        lua_setmetatable( L, -2 );
+        return 1;
+    }
+#else
+    // the children of the server cannot be the children of the calling
+    // process without CLONE_PARENT
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+LUALIB_API int luaopen_process_forkserver( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "exec", exec_lua },
+        { "pid", pid_lua },
+        { "close", close_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg *ptr = mmethod;
+
+    // create metatable
+    luaL_newmetatable( L, PROCESS_FORKSERVER_MT );
+    // metamethods
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    // methods
+    lua_pushstring( L, "__index" );
+    lua_newtable( L );
+    ptr = method;
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    lua_rawset( L, -3 );
+    lua_pop( L, 1 );
+
+    // push constructor
+    lua_pushcfunction( L, new_lua );
+
+    return 1;
+}
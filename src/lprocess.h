@@ -29,6 +29,11 @@
 #ifndef ___LPROCESS___
 #define ___LPROCESS___
 
+// linux specific APIs such as pipe2, splice and sched_setaffinity
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -43,15 +48,211 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <math.h>
 
 #if defined(__linux__)
 #include <linux/limits.h>
+#include <sys/syscall.h>
+#include <sched.h>
 #endif
 
 #include <lua.h>
 #include "../deps/lauxhlib/lauxhlib.h"
 
 
+// MARK: statistics
+// errors are counted by errno that less than this value
+#define PSTATS_NERRNO   256
+
+typedef struct {
+    // number of spawn attempts and failures
+    uint64_t spawn;
+    uint64_t spawnfail;
+    // number of process.fork calls and failures
+    uint64_t fork;
+    uint64_t forkfail;
+    // number of spawn and fork failures by errno
+    uint64_t errors[PSTATS_NERRNO];
+    // bytes written to stdin and read from stdout and stderr
+    uint64_t written;
+    uint64_t read;
+    // number of EAGAIN or EWOULDBLOCK returns
+    uint64_t eagain;
+    // number of reaped children
+    uint64_t reaped;
+    // number of process.child instances that are alive
+    uint64_t live;
+    // number of vmsplice data that are kept pinned after the instances have
+    // been collected
+    uint64_t pinned;
+} pstats_t;
+
+// module-wide counters; these are not thread-safe
+extern pstats_t PSTATS;
+
+static inline void pstats_error( int err )
+{
+    PSTATS.errors[err > 0 && err < PSTATS_NERRNO ? err : 0]++;
+}
+
+// count the return value of the non-blocking operation
+static inline int pstats_again( int err )
+{
+    if( err == EAGAIN || err == EWOULDBLOCK ){
+        PSTATS.eagain++;
+        return 1;
+    }
+    return 0;
+}
+
+// push the counters and reset them
+int stats_lua( lua_State *L );
+int resetstats_lua( lua_State *L );
+
+
+// MARK: timings
+// get the monotonic time in nanoseconds
+static inline uint64_t getnsec( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+// monotonic timestamps of the spawn phases in nanoseconds; 0 if not recorded
+typedef struct {
+    // spawn API is called
+    uint64_t start;
+    // before fork(2) or vfork(2)
+    uint64_t fork;
+    // the child process finished chdir(2) and dup2(2) (vfork mode only)
+    uint64_t setup;
+    // the child process calls execve(2) (vfork mode only)
+    uint64_t exec;
+    // spawn API returns the child process
+    uint64_t spawned;
+    // first output byte is read from stdout or stderr
+    uint64_t firstbyte;
+    // the child process is reaped by child:wait()
+    uint64_t exit;
+} ptimings_t;
+
+
+// MARK: buffer
+#define PROCESS_BUFFER_MT   "process.buffer"
+
+typedef struct {
+    char *mem;
+    // offset of unconsumed data
+    size_t head;
+    // offset of end of data
+    size_t tail;
+    size_t cap;
+} pbuf_t;
+
+
+LUALIB_API int luaopen_process_buffer( lua_State *L );
+
+
+#define pbuf_data(b)    ((b)->mem + (b)->head)
+#define pbuf_len(b)     ((b)->tail - (b)->head)
+
+
+static inline void pbuf_dispose( pbuf_t *b )
+{
+    if( b->mem ){
+        free( (void*)b->mem );
+    }
+    *b = (pbuf_t){ NULL, 0, 0, 0 };
+}
+
+
+// reserve the space of the specified size at the end of data
+static inline int pbuf_reserve( pbuf_t *b, size_t size )
+{
+    size_t len = pbuf_len( b );
+
+    if( b->cap - b->tail >= size ){
+        return 0;
+    }
+    // move unconsumed data to the head of memory
+    else if( b->head && b->cap - len >= size ){
+        memmove( b->mem, pbuf_data( b ), len );
+    }
+    else
+    {
+        size_t cap = b->cap ? b->cap : LUAL_BUFFERSIZE;
+        char *mem = NULL;
+
+        while( cap - len < size ){
+            cap *= 2;
+        }
+        if( !( mem = malloc( cap ) ) ){
+            return -1;
+        }
+        else if( len ){
+            memcpy( mem, pbuf_data( b ), len );
+        }
+        if( b->mem ){
+            free( (void*)b->mem );
+        }
+        b->mem = mem;
+        b->cap = cap;
+    }
+    b->head = 0;
+    b->tail = len;
+
+    return 0;
+}
+
+
+static inline void pbuf_consume( pbuf_t *b, size_t len )
+{
+    if( len >= pbuf_len( b ) ){
+        b->head = b->tail = 0;
+    }
+    else {
+        b->head += len;
+    }
+}
+
+
+// read data from the descriptor and append it to the buffer
+static inline ssize_t pbuf_read( pbuf_t *b, int fd, size_t size )
+{
+    ssize_t bytes = 0;
+
+    if( pbuf_reserve( b, size ) == -1 ){
+        return -1;
+    }
+    else if( ( bytes = read( fd, b->mem + b->tail, size ) ) > 0 ){
+        b->tail += (size_t)bytes;
+    }
+
+    return bytes;
+}
+
+
+// read buffer that remembers the scanned length to search the delimiter
+// only in the newly read data
+typedef struct {
+    pbuf_t buf;
+    size_t scanned;
+} prbuf_t;
+
+
+static inline void prbuf_consume( prbuf_t *rb, size_t len )
+{
+    pbuf_consume( &rb->buf, len );
+    rb->scanned = rb->scanned > len ? rb->scanned - len : 0;
+}
+
+
 // MARK: fd metatable
 #define PROCESS_CHILD_MT    "process.child"
 
@@ -59,22 +260,77 @@ typedef struct {
     pid_t pid;
     // 0: stdin, 1: stdout, 2: stderr
     int fds[3];
+    // descriptors are in non-blocking mode
+    int nonblock;
+    // total number of bytes written to stdin
+    uint64_t nwritten;
+    // reference of the queue of the strings pinned by vmsplice.
+    // each entry is released when the pipe has consumed its data
+    int pinref;
+    int pinhead;
+    int pintail;
+    // process descriptor of the child or -1 if not supported
+    int pidfd;
+    // exit status and resource usage that collected by child:wait().
+    // reaped is -1 if the child has been collected by someone else
+    int reaped;
+    int status;
+    struct rusage rusage;
+    ptimings_t timings;
+    // read buffers of stdout and stderr for child:readline and
+    // child:readframe
+    prbuf_t rbufs[2];
 } pchild_t;
 
 
 LUALIB_API int luaopen_process_child( lua_State *L );
 
+// write the data arguments to stdin of the child at index 1.
+// it is same as child:stdin( ... ), and the total length of the data is
+// stored to *total if it is not NULL
+int pchild_write( lua_State *L, size_t *total );
+
+
+// open the process descriptor that refers to pid.
+// returns -1 with ENOSYS if the system does not support it.
+static inline int pidfd_open_r( pid_t pid )
+{
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    // pidfd is always created with the close-on-exec flag
+    return (int)syscall( SYS_pidfd_open, pid, 0 );
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 
-// allocate process.child instance
+// allocate process.child instance.
+// the spawn timings are copied from t if it is not NULL
 static inline int newpchild( lua_State *L, pid_t pid, int ifd, int ofd,
-                             int efd )
+                             int efd, int nonblock, ptimings_t *t )
 {
     pchild_t *chd = lua_newuserdata( L, sizeof( pchild_t ) );
 
     *chd = (pchild_t){
         .pid = pid,
-        .fds = { ifd, ofd, efd }
+        .fds = { ifd, ofd, efd },
+        .nonblock = nonblock,
+        .nwritten = 0,
+        .pinref = LUA_NOREF,
+        .pinhead = 0,
+        .pintail = 0,
+        // the child has not been reaped yet, so the pid cannot be recycled
+        .pidfd = pidfd_open_r( pid ),
+        .reaped = 0,
+        .status = 0
     };
+    if( t ){
+        chd->timings = *t;
+        chd->timings.spawned = getnsec();
+    }
+    PSTATS.live++;
     luaL_getmetatable( L, PROCESS_CHILD_MT );
     lua_setmetatable( L, -2 );
 
@@ -82,6 +338,152 @@ static inline int newpchild( lua_State *L, pid_t pid, int ifd, int ofd,
 }
 
 
+// push the table of struct rusage
+static inline void pushrusage( lua_State *L, struct rusage *usage )
+{
+    lua_createtable( L, 0, 16 );
+    lauxh_pushnum2tbl( L, "maxrss", usage->ru_maxrss );
+    lauxh_pushnum2tbl( L, "ixrss", usage->ru_ixrss );
+    lauxh_pushnum2tbl( L, "idrss", usage->ru_idrss );
+    lauxh_pushnum2tbl( L, "isrss", usage->ru_isrss );
+    lauxh_pushnum2tbl( L, "minflt", usage->ru_minflt );
+    lauxh_pushnum2tbl( L, "majflt", usage->ru_majflt );
+    lauxh_pushnum2tbl( L, "nswap", usage->ru_nswap );
+    lauxh_pushnum2tbl( L, "inblock", usage->ru_inblock );
+    lauxh_pushnum2tbl( L, "oublock", usage->ru_oublock );
+    lauxh_pushnum2tbl( L, "msgsnd", usage->ru_msgsnd );
+    lauxh_pushnum2tbl( L, "msgrcv", usage->ru_msgrcv );
+    lauxh_pushnum2tbl( L, "nsignals", usage->ru_nsignals );
+    lauxh_pushnum2tbl( L, "nvcsw", usage->ru_nvcsw );
+    lauxh_pushnum2tbl( L, "nivcsw", usage->ru_nivcsw );
+    lua_pushstring( L, "utime" );
+    lua_createtable( L, 0, 2 );
+    lauxh_pushnum2tbl( L, "sec", usage->ru_utime.tv_sec );
+    lauxh_pushnum2tbl( L, "usec", usage->ru_utime.tv_usec );
+    lua_rawset( L, -3 );
+    lua_pushstring( L, "stime" );
+    lua_createtable( L, 0, 2 );
+    lauxh_pushnum2tbl( L, "sec", usage->ru_stime.tv_sec );
+    lauxh_pushnum2tbl( L, "usec", usage->ru_stime.tv_usec );
+    lua_rawset( L, -3 );
+}
+
+
+// push the table that describes the status of waitpid
+static inline void pushwaitstatus( lua_State *L, pid_t pid, int rc )
+{
+    lua_createtable( L, 0, 2 );
+    lauxh_pushnum2tbl( L, "pid", pid );
+    // exit status
+    if( WIFEXITED( rc ) ){
+        lauxh_pushnum2tbl( L, "exit", WEXITSTATUS( rc ) );
+    }
+    // exit signal number
+    else if( WIFSIGNALED( rc ) ){
+        lauxh_pushnum2tbl( L, "termsig", WTERMSIG( rc ) );
+    }
+    // stop signal
+    else if( WIFSTOPPED( rc ) ){
+        lauxh_pushnum2tbl( L, "stopsig", WSTOPSIG( rc ) );
+    }
+    // continue signal
+    else if( WIFCONTINUED( rc ) ){
+        lauxh_pushbool2tbl( L, "continue", 1 );
+    }
+}
+
+
+// MARK: fork server
+#define PROCESS_FORKSERVER_MT   "process.forkserver"
+
+LUALIB_API int luaopen_process_forkserver( lua_State *L );
+
+
+// MARK: pool
+#define PROCESS_POOL_MT     "process.pool"
+
+LUALIB_API int luaopen_process_pool( lua_State *L );
+
+
+// MARK: poller
+#define PROCESS_POLLER_MT   "process.poller"
+
+LUALIB_API int luaopen_process_poller( lua_State *L );
+
+
+// MARK: command
+#define PROCESS_COMMAND_MT  "process.command"
+
+LUALIB_API int luaopen_process_command( lua_State *L );
+
+
+// MARK: option table
+static inline const char *opt_string( lua_State *L, int idx, const char *k,
+                                      const char *def )
+{
+    const char *v = def;
+
+    lua_getfield( L, idx, k );
+    switch( lua_type( L, -1 ) ){
+        case LUA_TNONE:
+        case LUA_TNIL:
+        break;
+        case LUA_TSTRING:
+            // NOTE: value is still referenced from the table
+            v = lua_tostring( L, -1 );
+        break;
+        default:
+            luaL_argerror( L, idx, lua_pushfstring( L, "%s must be string", k ) );
+    }
+    lua_pop( L, 1 );
+
+    return v;
+}
+
+
+static inline lua_Integer opt_integer( lua_State *L, int idx, const char *k,
+                                       lua_Integer def )
+{
+    lua_Integer v = def;
+
+    lua_getfield( L, idx, k );
+    switch( lua_type( L, -1 ) ){
+        case LUA_TNONE:
+        case LUA_TNIL:
+        break;
+        case LUA_TNUMBER:
+            v = lua_tointeger( L, -1 );
+        break;
+        default:
+            luaL_argerror( L, idx, lua_pushfstring( L, "%s must be number", k ) );
+    }
+    lua_pop( L, 1 );
+
+    return v;
+}
+
+
+static inline int opt_boolean( lua_State *L, int idx, const char *k, int def )
+{
+    int v = def;
+
+    lua_getfield( L, idx, k );
+    switch( lua_type( L, -1 ) ){
+        case LUA_TNONE:
+        case LUA_TNIL:
+        break;
+        case LUA_TBOOLEAN:
+            v = lua_toboolean( L, -1 );
+        break;
+        default:
+            luaL_argerror( L, idx, lua_pushfstring( L, "%s must be boolean", k ) );
+    }
+    lua_pop( L, 1 );
+
+    return v;
+}
+
+
 // MARK: array
 typedef struct {
     char **elts;
@@ -229,14 +631,61 @@ typedef enum {
 } iop_type_e;
 
 
+// redirection of stdin, stdout and stderr
+typedef enum {
+    // create pipe
+    PSTDIO_PIPE = 0,
+    // inherit the descriptor of the calling process
+    PSTDIO_INHERIT,
+    // open /dev/null
+    PSTDIO_NULL,
+    // open the file
+    PSTDIO_FILE,
+    // duplicate the existing descriptor
+    PSTDIO_FD,
+    // duplicate the stdout of the child process (stderr only)
+    PSTDIO_STDOUT
+} pstdio_e;
+
+
+typedef struct {
+    pstdio_e type;
+    // PSTDIO_FD
+    int fd;
+    // PSTDIO_FILE
+    const char *path;
+    int flags;
+    mode_t mode;
+} pstdio_t;
+
+#define pstdio_pipe (pstdio_t){ \
+    .type = PSTDIO_PIPE,        \
+    .fd = -1,                   \
+    .path = NULL,               \
+    .flags = 0,                 \
+    .mode = 0                   \
+}
+
+
 typedef struct {
+    // pair of descriptors for each stream;
+    // the descriptors of the child side are duplicated to the stdin, stdout
+    // and stderr of the child process, and the descriptors of the parent side
+    // are set only if the stream is redirected to pipe.
     int fds[6];
+    pstdio_e types[3];
 } iopipe_t;
 
-#define iop_no_value (iopipe_t){    \
-    .fds = {}                       \
+#define iop_no_value (iopipe_t){                        \
+    .fds = { -1, -1, -1, -1, -1, -1 },                  \
+    .types = { PSTDIO_PIPE, PSTDIO_PIPE, PSTDIO_PIPE }  \
 }
 
+// index of descriptor of the child side of stream
+#define iop_child_idx(i)    ((i) == STDIN_FILENO ? IOP_IN_READ : (i) * 2 + 1)
+// index of descriptor of the parent side of stream
+#define iop_parent_idx(i)   ((i) == STDIN_FILENO ? IOP_IN_WRITE : (i) * 2)
+
 
 static inline void iop_dispose( iopipe_t *io )
 {
@@ -244,31 +693,82 @@ static inline void iop_dispose( iopipe_t *io )
 
     for(; i < 6; i++ )
     {
-        if( io->fds[i] ){
+        if( io->fds[i] != -1 ){
             close( io->fds[i] );
-            io->fds[i] = 0;
+            io->fds[i] = -1;
         }
     }
 }
 
 
-static inline int iop_init( iopipe_t *iop )
+static inline int iop_pipe( int *fds )
 {
-    memset( (void*)iop, 0, sizeof( iop ) );
-    // create pipes
-    if( pipe( iop->fds ) == 0 &&  pipe( iop->fds + 2 ) == 0 &&
-        pipe( iop->fds + 4 ) == 0 )
+#if defined(__linux__)
+    return pipe2( fds, O_CLOEXEC );
+#else
+    if( pipe( fds ) == 0 ){
+        fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+        fcntl( fds[1], F_SETFD, FD_CLOEXEC );
+        return 0;
+    }
+
+    return -1;
+#endif
+}
+
+
+static inline int iop_init( iopipe_t *iop, pstdio_t *spec )
+{
+    int i = 0;
+
+    *iop = iop_no_value;
+    for(; i < 3; i++ )
     {
-        int i = 0;
+        int *fd = iop->fds + iop_child_idx( i );
 
-        for(; i < 6; i++ ){
-            fcntl( iop->fds[i], F_SETFD, FD_CLOEXEC );
-        }
+        iop->types[i] = spec[i].type;
+        switch( spec[i].type )
+        {
+            case PSTDIO_PIPE:
+                if( iop_pipe( iop->fds + i * 2 ) == -1 ){
+                    goto FAILURE;
+                }
+            break;
 
-        return 0;
+            case PSTDIO_NULL:
+                if( ( *fd = open( "/dev/null", ( i ? O_WRONLY : O_RDONLY )|
+                                  O_CLOEXEC ) ) == -1 ){
+                    goto FAILURE;
+                }
+            break;
+
+            case PSTDIO_FILE:
+                if( ( *fd = open( spec[i].path, spec[i].flags|O_CLOEXEC,
+                                  spec[i].mode ) ) == -1 ){
+                    goto FAILURE;
+                }
+            break;
+
+            // NOTE: duplicate it to above the standard descriptors so that
+            // it will not be overwritten by the other streams
+            case PSTDIO_FD:
+                if( ( *fd = fcntl( spec[i].fd, F_DUPFD_CLOEXEC,
+                                   STDERR_FILENO + 1 ) ) == -1 ){
+                    goto FAILURE;
+                }
+            break;
+
+            // PSTDIO_INHERIT
+            // PSTDIO_STDOUT
+            default:
+            break;
+        }
     }
-    iop_dispose( iop );
 
+    return 0;
+
+FAILURE:
+    iop_dispose( iop );
     return -1;
 }
 
@@ -287,40 +787,505 @@ static inline int setnonblock( int fd )
 
 static inline int iop_setnonblock( iopipe_t *iop )
 {
-    if( setnonblock( iop->fds[IOP_IN_WRITE] ) == -1 ||
-        setnonblock( iop->fds[IOP_OUT_READ] ) == -1 ||
-        setnonblock( iop->fds[IOP_ERR_READ] ) == -1 ){
+    int i = 0;
+
+    for(; i < 3; i++ )
+    {
+        if( iop->types[i] == PSTDIO_PIPE &&
+            setnonblock( iop->fds[iop_parent_idx( i )] ) == -1 ){
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+#if defined(__linux__)
+// read /proc/sys/fs/pipe-max-size
+static inline int pipemaxsize( void )
+{
+    int fd = open( "/proc/sys/fs/pipe-max-size", O_RDONLY|O_CLOEXEC );
+    char buf[32];
+    ssize_t len = 0;
+
+    if( fd == -1 ){
+        return -1;
+    }
+    len = read( fd, buf, sizeof( buf ) - 1 );
+    close( fd );
+    if( len <= 0 ){
         return -1;
     }
+    buf[len] = 0;
+
+    return atoi( buf );
+}
+#endif
+
+
+// set the capacity of the pipes to size bytes at least. the size is capped by
+// /proc/sys/fs/pipe-max-size if the calling process is unprivileged.
+static inline int iop_setpipesize( iopipe_t *iop, int size )
+{
+#if defined(__linux__)
+    int i = 0;
+
+    for(; i < 3; i++ )
+    {
+        int fd = iop->fds[iop_parent_idx( i )];
+
+        if( iop->types[i] == PSTDIO_PIPE &&
+            fcntl( fd, F_SETPIPE_SZ, size ) == -1 )
+        {
+            int err = errno;
+            int max = 0;
+
+            if( err != EPERM || ( max = pipemaxsize() ) <= 0 ||
+                max >= size ){
+                errno = err;
+                return -1;
+            }
+            // use the capped size for the rest of pipes
+            size = max;
+            if( fcntl( fd, F_SETPIPE_SZ, size ) == -1 ){
+                return -1;
+            }
+        }
+    }
 
     return 0;
+#else
+    (void)iop;
+    (void)size;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+
+// check the pipesize option of the options table at idx
+static inline int iop_checkpipesize( lua_State *L, int idx )
+{
+    lua_Integer size = opt_integer( L, idx, "pipesize", 0 );
+
+    luaL_argcheck( L, size >= 0 && size <= INT32_MAX, idx,
+                   "pipesize must be unsigned integer" );
+
+    return (int)size;
 }
 
 
 static inline int iop_set( iopipe_t *iop )
 {
-    // close stdin-write, stdout-read, stderr-read
-    close( iop->fds[IOP_IN_WRITE] );
-    close( iop->fds[IOP_OUT_READ] );
-    close( iop->fds[IOP_ERR_READ] );
+    int i = 0;
+
     // set stdin-read, stdout-write, stderr-write
-    if( dup2( iop->fds[IOP_IN_READ], STDIN_FILENO ) != -1 &&
-        dup2( iop->fds[IOP_OUT_WRITE], STDOUT_FILENO ) != -1 &&
-        dup2( iop->fds[IOP_ERR_WRITE], STDERR_FILENO ) != -1 ){
-        return 0;
+    for(; i < 3; i++ )
+    {
+        int fd = iop->fds[iop_child_idx( i )];
+
+        switch( iop->types[i] )
+        {
+            case PSTDIO_INHERIT:
+            break;
+
+            case PSTDIO_STDOUT:
+                if( dup2( STDOUT_FILENO, STDERR_FILENO ) == -1 ){
+                    return -1;
+                }
+            break;
+
+            default:
+                // dup2 does not clear the close-on-exec flag if descriptors
+                // are the same
+                if( fd == i ){
+                    if( fcntl( fd, F_SETFD, 0 ) == -1 ){
+                        return -1;
+                    }
+                }
+                else if( dup2( fd, i ) == -1 ){
+                    return -1;
+                }
+        }
     }
 
-    return -1;
+    return 0;
 }
 
 
 static inline void iop_unset( iopipe_t *iop )
 {
+    int i = 0;
+
     // close stdin-read, stdout-write, stderr-write
-    close( iop->fds[IOP_IN_READ] );
-    close( iop->fds[IOP_OUT_WRITE] );
-    close( iop->fds[IOP_ERR_WRITE] );
+    for(; i < 3; i++ )
+    {
+        int *fd = iop->fds + iop_child_idx( i );
+
+        if( *fd != -1 ){
+            close( *fd );
+            *fd = -1;
+        }
+    }
+}
+
+
+static inline void iop_checkstdio_field( lua_State *L, int idx, int stream,
+                                         pstdio_t *spec )
+{
+    static const char *const names[] = { "stdin", "stdout", "stderr" };
+
+    *spec = pstdio_pipe;
+    switch( lua_type( L, -1 ) )
+    {
+        case LUA_TNONE:
+        case LUA_TNIL:
+            return;
+
+        case LUA_TSTRING: {
+            const char *v = lua_tostring( L, -1 );
+
+            if( strcmp( v, "pipe" ) == 0 ){
+                return;
+            }
+            else if( strcmp( v, "inherit" ) == 0 ){
+                spec->type = PSTDIO_INHERIT;
+                return;
+            }
+            else if( strcmp( v, "null" ) == 0 ){
+                spec->type = PSTDIO_NULL;
+                return;
+            }
+            else if( stream == STDERR_FILENO && strcmp( v, "stdout" ) == 0 ){
+                spec->type = PSTDIO_STDOUT;
+                return;
+            }
+        } break;
+
+        case LUA_TNUMBER:
+            spec->type = PSTDIO_FD;
+            spec->fd = (int)lua_tointeger( L, -1 );
+            if( spec->fd >= 0 ){
+                return;
+            }
+        break;
+
+        case LUA_TTABLE:
+            spec->type = PSTDIO_FILE;
+            lua_getfield( L, -1, "path" );
+            if( lua_type( L, -1 ) == LUA_TSTRING ){
+                // NOTE: value is still referenced from the table
+                spec->path = lua_tostring( L, -1 );
+                lua_pop( L, 1 );
+                lua_getfield( L, -1, "flags" );
+                spec->flags = lua_isnoneornil( L, -1 ) ?
+                              ( stream ? O_WRONLY|O_CREAT|O_TRUNC : O_RDONLY ) :
+                              (int)lua_tointeger( L, -1 );
+                lua_pop( L, 1 );
+                lua_getfield( L, -1, "mode" );
+                spec->mode = lua_isnoneornil( L, -1 ) ? 0644 :
+                             (mode_t)lua_tointeger( L, -1 );
+                lua_pop( L, 1 );
+                return;
+            }
+            lua_pop( L, 1 );
+        break;
+    }
+
+    luaL_argerror( L, idx, lua_pushfstring(
+        L, "stdio.%s must be \"pipe\", \"inherit\", \"null\", "
+        "descriptor or file table", names[stream]
+    ));
 }
 
 
+// check the stdio field of the options table
+static inline void iop_checkstdio( lua_State *L, int idx, pstdio_t *spec )
+{
+    int i = 0;
+
+    lua_getfield( L, idx, "stdio" );
+    switch( lua_type( L, -1 ) )
+    {
+        case LUA_TNONE:
+        case LUA_TNIL:
+            spec[0] = spec[1] = spec[2] = pstdio_pipe;
+        break;
+
+        // apply same redirection to all streams
+        case LUA_TSTRING:
+            for(; i < 3; i++ ){
+                iop_checkstdio_field( L, idx, i, spec + i );
+            }
+        break;
+
+        case LUA_TTABLE:
+            lua_getfield( L, -1, "stdin" );
+            iop_checkstdio_field( L, idx, STDIN_FILENO, spec );
+            lua_pop( L, 1 );
+            lua_getfield( L, -1, "stdout" );
+            iop_checkstdio_field( L, idx, STDOUT_FILENO, spec + 1 );
+            lua_pop( L, 1 );
+            lua_getfield( L, -1, "stderr" );
+            iop_checkstdio_field( L, idx, STDERR_FILENO, spec + 2 );
+            lua_pop( L, 1 );
+        break;
+
+        default:
+            luaL_argerror( L, idx, "stdio must be \"pipe\", \"inherit\", "
+                           "\"null\" or table" );
+    }
+    lua_pop( L, 1 );
+}
+
+
+// MARK: child attributes
+#if defined(__linux__)
+// check the array of cpu numbers at idx; errors are reported as the
+// argument at arg
+static inline void checkcpuset( lua_State *L, int idx, cpu_set_t *set,
+                                int arg )
+{
+    int i = 1;
+
+    luaL_argcheck( L, lua_type( L, idx ) == LUA_TTABLE, arg,
+                   "cpus must be array of cpu number" );
+    CPU_ZERO( set );
+    lua_rawgeti( L, idx, i );
+    while( !lua_isnil( L, -1 ) )
+    {
+        lua_Integer cpu = 0;
+
+        if( lua_type( L, -1 ) != LUA_TNUMBER ||
+            ( cpu = lua_tointeger( L, -1 ) ) < 0 || cpu >= CPU_SETSIZE ){
+            luaL_argerror( L, arg, "cpus must be array of cpu number" );
+        }
+        CPU_SET( (int)cpu, set );
+        lua_pop( L, 1 );
+        lua_rawgeti( L, idx, ++i );
+    }
+    lua_pop( L, 1 );
+}
+#endif
+
+
+#if defined(__linux__)
+// i/o scheduling class and priority of ioprio_set(2); glibc does not provide
+// these definitions
+#ifndef IOPRIO_CLASS_NONE
+#define IOPRIO_CLASS_NONE   0
+#define IOPRIO_CLASS_RT     1
+#define IOPRIO_CLASS_BE     2
+#define IOPRIO_CLASS_IDLE   3
+#endif
+
+#ifndef IOPRIO_WHO_PROCESS
+#define IOPRIO_WHO_PROCESS  1
+#define IOPRIO_WHO_PGRP     2
+#define IOPRIO_WHO_USER     3
+#endif
+
+#define PIOPRIO_SHIFT       13
+#define PIOPRIO_VALUE(class,data)   (((class) << PIOPRIO_SHIFT) | (data))
+#define PIOPRIO_CLASS(v)    ((v) >> PIOPRIO_SHIFT)
+#define PIOPRIO_DATA(v)     ((v) & ((1 << PIOPRIO_SHIFT) - 1))
+
+static inline int ioprio_set_r( int which, int who, int ioprio )
+{
+#if defined(SYS_ioprio_set)
+    return (int)syscall( SYS_ioprio_set, which, who, ioprio );
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static inline int ioprio_get_r( int which, int who )
+{
+#if defined(SYS_ioprio_get)
+    return (int)syscall( SYS_ioprio_get, which, who );
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+#endif
+
+
+// MARK: resource limits
+#if defined(RLIM_NLIMITS)
+#define PRLIMIT_MAX RLIM_NLIMITS
+#else
+#define PRLIMIT_MAX 16
+#endif
+
+// RLIM_INFINITY is represented by math.huge
+static inline void pushrlim( lua_State *L, rlim_t v )
+{
+    if( v == RLIM_INFINITY ){
+        lua_pushnumber( L, HUGE_VAL );
+    }
+    else {
+        lua_pushinteger( L, (lua_Integer)v );
+    }
+}
+
+
+// check the limit value at idx; errors are reported as the argument at arg
+static inline rlim_t checkrlim( lua_State *L, int idx, int arg )
+{
+    lua_Number v = 0;
+
+    if( lua_type( L, idx ) == LUA_TNUMBER )
+    {
+        v = lua_tonumber( L, idx );
+        if( v == HUGE_VAL ){
+            return RLIM_INFINITY;
+        }
+        // NOTE: NaN fails all comparisons, and the fraction is detected by
+        // the round trip conversion
+        else if( v >= 0 && v < (lua_Number)RLIM_INFINITY &&
+                 v == (lua_Number)(rlim_t)v ){
+            return (rlim_t)v;
+        }
+    }
+    luaL_argerror( L, arg, "limit must be unsigned integer or math.huge" );
+
+    return 0;
+}
+
+
+// attributes that are applied in the child process before execve(2).
+// it must not contain any pointers since it is passed to the fork server.
+typedef struct {
+    // resource limits; the bit of each resource is set in userlimit
+    uint32_t userlimit;
+    struct rlimit rlimits[PRLIMIT_MAX];
+    // scheduling policy and static priority
+    int usesched;
+    int sched;
+    int schedprio;
+    // nice value
+    int usenice;
+    int nice;
+    // i/o scheduling class and priority
+    int useioprio;
+    int ioprio;
+    // cpu affinity
+    int useaffinity;
+#if defined(__linux__)
+    cpu_set_t affinity;
+#endif
+} pattr_t;
+
+
+/**
+ *  pattr_check
+ *  initialize attr and set the attributes of the options table at idx.
+ *  an error is raised if the options are invalid.
+ */
+void pattr_check( lua_State *L, int idx, pattr_t *attr );
+
+
+// MARK: spawn
+typedef struct {
+    const char *path;
+    // NULL terminated argument array
+    char **argv;
+    // NULL terminated environment array, or NULL to inherit the environment
+    // of the calling process
+    char **envp;
+    // working directory of the child process, or NULL to inherit
+    const char *pwd;
+    iopipe_t *iop;
+    // use fork(2) instead of vfork(2)
+    int usefork;
+    // create the child process as a child of the parent of the calling
+    // process by clone(2) with CLONE_PARENT (linux only)
+    int sibling;
+    // process id of the child process that failed in sibling mode; it must
+    // be reaped by the parent of the calling process
+    pid_t zombie;
+    // timestamps of the spawn phases, or NULL
+    ptimings_t *timings;
+    // attributes of the child process, or NULL
+    pattr_t *attr;
+    // path of the cgroup v2 directory that the child process is placed in,
+    // or NULL (linux only)
+    const char *cgroup;
+    // descriptor of the cgroup directory that is opened by pspawn
+    int cgroupfd;
+} pspawn_t;
+
+
+/**
+ *  pspawn
+ *  create the child process that described by ps, and return the process id
+ *  of the child process on success, or -1 on failure.
+ *  if the child process failed to set up its environment or execute the
+ *  file, the child process is reaped (except in sibling mode) and errno is
+ *  set to the error that occurred in the child process.
+ *  a file name without slash is resolved to the absolute pathname in the
+ *  parent process by the resolved-executable cache if possible.
+ *  if the cgroup is specified, the child process is created in that cgroup
+ *  by clone3(2) with CLONE_INTO_CGROUP if possible, otherwise the child
+ *  process moves itself to that cgroup before executing the file.
+ */
+pid_t pspawn( pspawn_t *ps );
+
+
+// push the statistics and the entries of the resolved-executable cache that
+// is used by pspawn, and flush the cache.
+int execcache_lua( lua_State *L );
+int flushexeccache_lua( lua_State *L );
+
+
+// create the cgroup v2 directory and write the limits to the interface files,
+// remove the cgroup, and push the usage of the cgroup. (linux only)
+int mkcgroup_lua( lua_State *L );
+int rmcgroup_lua( lua_State *L );
+int cgroupstat_lua( lua_State *L );
+
+
+// spawn attributes that own all of the strings
+typedef struct {
+    const char *path;
+    // number of arguments excluding the last NULL
+    size_t argc;
+    char **argv;
+    char **envp;
+    const char *pwd;
+    const char *cgroup;
+    pstdio_t stdio[3];
+    int nonblock;
+    // capacity of the pipes, or 0 to use the default capacity
+    int pipesize;
+    int usefork;
+    pattr_t attr;
+    // memory block of the strings and arrays
+    char *mem;
+} pcmd_t;
+
+
+/**
+ *  pcmd_init
+ *  create the spawn attributes from the lua arguments that placed at idx;
+ *  path, argv, env and options table, and return 0 on success, or -1 on
+ *  failure with errno. an error is raised if the arguments are invalid.
+ */
+int pcmd_init( lua_State *L, pcmd_t *cmd, int idx );
+void pcmd_dispose( pcmd_t *cmd );
+
+
+/**
+ *  pcmd_spawn
+ *  create the pipes into iop and the child process that described by cmd,
+ *  and return the process id of the child process on success, or -1 on
+ *  failure. the descriptors of the child side are closed on success.
+ *  the timestamps of the spawn phases are recorded into t if it is not NULL.
+ */
+pid_t pcmd_spawn( pcmd_t *cmd, iopipe_t *iop, ptimings_t *t );
+
+
 #endif
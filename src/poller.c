@@ -0,0 +1,483 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/poller.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+
+
+#define POLLER_MAXEVENTS    64
+
+// stream index of the registered descriptor
+enum {
+    PSTREAM_STDIN = 0,
+    PSTREAM_STDOUT,
+    PSTREAM_STDERR,
+    PSTREAM_EXIT
+};
+
+static const char *const STREAM_NAMES[] = {
+    "stdin", "stdout", "stderr", "exit", NULL
+};
+
+
+typedef struct {
+    pchild_t *chd;
+    // reference of process.child instance
+    int ref;
+    // registered descriptors
+    int fds[4];
+    // index of the next unused slot
+    int next;
+} pslot_t;
+
+
+typedef struct {
+    int epfd;
+    int maxevents;
+    struct epoll_event *evs;
+    // number of allocated slots and used slots
+    int nslot;
+    int nused;
+    // head of the list of unused slots, or -1 if empty
+    int freeslot;
+    pslot_t *slots;
+    // reference of the table that maps the child to the slot index
+    int mapref;
+} ppoller_t;
+
+
+// epoll data holds the slot index and the stream index
+#define slot2data( idx, stream )    ( ( (uint64_t)(idx) << 2 ) | (stream) )
+#define data2slot( data )           (int)( (data) >> 2 )
+#define data2stream( data )         (int)( (data) & 0x3 )
+
+
+static inline pslot_t *getslot( lua_State *L, ppoller_t *p, int idx )
+{
+    pslot_t *slot = NULL;
+
+    lua_rawgeti( L, LUA_REGISTRYINDEX, p->mapref );
+    lua_pushvalue( L, idx );
+    lua_rawget( L, -2 );
+    if( lua_type( L, -1 ) == LUA_TNUMBER ){
+        slot = p->slots + lua_tointeger( L, -1 );
+    }
+    lua_pop( L, 2 );
+
+    return slot;
+}
+
+
+static inline pslot_t *newslot( ppoller_t *p )
+{
+    pslot_t *slot = NULL;
+
+    // extend slots by doubling and chain the new slots to the unused list
+    if( p->freeslot == -1 )
+    {
+        int nslot = p->nslot ? p->nslot * 2 : 8;
+        int i = p->nslot;
+
+        if( nslot > INT32_MAX / 2 / (int)sizeof( pslot_t ) ){
+            errno = ENOMEM;
+            return NULL;
+        }
+        else if( !( slot = realloc( p->slots, sizeof( pslot_t ) * nslot ) ) ){
+            return NULL;
+        }
+        p->slots = slot;
+        for(; i < nslot; i++ ){
+            p->slots[i] = (pslot_t){
+                .chd = NULL,
+                .ref = LUA_NOREF,
+                .fds = { -1, -1, -1, -1 },
+                .next = ( i + 1 < nslot ) ? i + 1 : -1
+            };
+        }
+        p->freeslot = p->nslot;
+        p->nslot = nslot;
+    }
+
+    slot = p->slots + p->freeslot;
+    p->freeslot = slot->next;
+    slot->next = -1;
+    p->nused++;
+
+    return slot;
+}
+
+
+static void unregister( lua_State *L, ppoller_t *p, pslot_t *slot, int stream )
+{
+    int i = 0;
+
+    for(; i < 4; i++ )
+    {
+        if( slot->fds[i] != -1 && ( stream == -1 || stream == i ) ){
+            epoll_ctl( p->epfd, EPOLL_CTL_DEL, slot->fds[i], NULL );
+            slot->fds[i] = -1;
+        }
+    }
+
+    // release the slot if there are no registered descriptors
+    if( slot->fds[0] == -1 && slot->fds[1] == -1 && slot->fds[2] == -1 &&
+        slot->fds[3] == -1 )
+    {
+        if( slot->ref != LUA_NOREF ){
+            lua_rawgeti( L, LUA_REGISTRYINDEX, p->mapref );
+            lua_rawgeti( L, LUA_REGISTRYINDEX, slot->ref );
+            lua_pushnil( L );
+            lua_rawset( L, -3 );
+            lua_pop( L, 1 );
+            luaL_unref( L, LUA_REGISTRYINDEX, slot->ref );
+            slot->ref = LUA_NOREF;
+        }
+        slot->chd = NULL;
+        slot->next = p->freeslot;
+        p->freeslot = (int)( slot - p->slots );
+        p->nused--;
+    }
+}
+
+
+// register the descriptor of the stream to epoll
+static inline int register_stream( ppoller_t *p, pslot_t *slot, int stream,
+                                   int fd )
+{
+    struct epoll_event ev = {
+        .events = ( stream == PSTREAM_STDIN ) ? EPOLLOUT :
+                  ( stream == PSTREAM_EXIT ) ? EPOLLIN|EPOLLONESHOT :
+                  EPOLLIN,
+        .data.u64 = slot2data( slot - p->slots, stream )
+    };
+
+    if( epoll_ctl( p->epfd, EPOLL_CTL_ADD, fd, &ev ) == -1 ){
+        return -1;
+    }
+    slot->fds[stream] = fd;
+
+    return 0;
+}
+
+
+static int add_lua( lua_State *L )
+{
+    ppoller_t *p = luaL_checkudata( L, 1, PROCESS_POLLER_MT );
+    pchild_t *chd = luaL_checkudata( L, 2, PROCESS_CHILD_MT );
+    pslot_t *slot = getslot( L, p, 2 );
+    int fds[4] = { -1, chd->fds[1], chd->fds[2], -1 };
+    int i = 0;
+
+    // stdin is always writable until the pipe is full, so the write
+    // interest must be requested explicitly
+    if( !lua_isnoneornil( L, 3 ) )
+    {
+        luaL_checktype( L, 3, LUA_TTABLE );
+        if( opt_boolean( L, 3, "stdin", 0 ) ){
+            fds[PSTREAM_STDIN] = chd->fds[0];
+        }
+    }
+
+    // already registered
+    if( slot )
+    {
+        // add the write interest of stdin
+        if( fds[PSTREAM_STDIN] != -1 && slot->fds[PSTREAM_STDIN] == -1 &&
+            register_stream( p, slot, PSTREAM_STDIN,
+                             fds[PSTREAM_STDIN] ) == -1 ){
+            goto FAILED;
+        }
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+    else if( !( slot = newslot( p ) ) ){
+        goto FAILED;
+    }
+
+    // child exit is reported only once
+    if( !chd->reaped ){
+        fds[PSTREAM_EXIT] = chd->pidfd;
+    }
+    slot->chd = chd;
+    for(; i < 4; i++ )
+    {
+        if( fds[i] != -1 && register_stream( p, slot, i, fds[i] ) == -1 ){
+            int err = errno;
+
+            // release the slot
+            unregister( L, p, slot, -1 );
+            errno = err;
+            goto FAILED;
+        }
+    }
+
+    // retain the child until it is removed
+    lua_settop( L, 2 );
+    lua_rawgeti( L, LUA_REGISTRYINDEX, p->mapref );
+    lua_pushvalue( L, 2 );
+    lua_pushinteger( L, slot - p->slots );
+    lua_rawset( L, -3 );
+    lua_pop( L, 1 );
+    slot->ref = luaL_ref( L, LUA_REGISTRYINDEX );
+    lua_pushboolean( L, 1 );
+
+    return 1;
+
+FAILED:
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int del_lua( lua_State *L )
+{
+    ppoller_t *p = luaL_checkudata( L, 1, PROCESS_POLLER_MT );
+    int stream = -1;
+    pslot_t *slot = NULL;
+
+    luaL_checkudata( L, 2, PROCESS_CHILD_MT );
+    if( !lua_isnoneornil( L, 3 ) ){
+        stream = luaL_checkoption( L, 3, NULL, STREAM_NAMES );
+    }
+
+    if( ( slot = getslot( L, p, 2 ) ) ){
+        unregister( L, p, slot, stream );
+    }
+
+    return 0;
+}
+
+
+static int wait_lua( lua_State *L )
+{
+    ppoller_t *p = luaL_checkudata( L, 1, PROCESS_POLLER_MT );
+    lua_Integer msec = luaL_optinteger( L, 2, -1 );
+    int nev = epoll_wait( p->epfd, p->evs, p->maxevents,
+                          msec < 0 ? -1 : msec > INT32_MAX ? INT32_MAX :
+                          (int)msec );
+    int i = 0;
+
+    // got error
+    if( nev == -1 ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        // interrupted by signal
+        if( errno == EINTR ){
+            lua_pushboolean( L, 1 );
+            return 3;
+        }
+        return 2;
+    }
+
+    // push ready events
+    lua_createtable( L, nev, 0 );
+    for(; i < nev; i++ )
+    {
+        pslot_t *slot = p->slots + data2slot( p->evs[i].data.u64 );
+        int stream = data2stream( p->evs[i].data.u64 );
+        uint32_t events = p->evs[i].events;
+        const char *event = "read";
+
+        if( stream == PSTREAM_EXIT ){
+            event = "exit";
+        }
+        else if( events & EPOLLERR ){
+            event = "error";
+        }
+        else if( events & ( EPOLLIN|EPOLLOUT ) ){
+            event = ( events & EPOLLOUT ) ? "write" : "read";
+        }
+        else if( events & EPOLLHUP ){
+            event = "hup";
+        }
+
+        lua_createtable( L, 0, 3 );
+        lua_pushstring( L, "child" );
+        lua_rawgeti( L, LUA_REGISTRYINDEX, slot->ref );
+        lua_rawset( L, -3 );
+        lua_pushstring( L, "stream" );
+        lua_pushstring( L, STREAM_NAMES[stream] );
+        lua_rawset( L, -3 );
+        lua_pushstring( L, "event" );
+        lua_pushstring( L, event );
+        lua_rawset( L, -3 );
+        lua_rawseti( L, -2, i + 1 );
+
+        // the one-shot descriptor is no longer needed, and the slot is
+        // released if all streams have been removed
+        if( stream == PSTREAM_EXIT ){
+            unregister( L, p, slot, PSTREAM_EXIT );
+        }
+    }
+
+    return 1;
+}
+
+
+static int len_lua( lua_State *L )
+{
+    ppoller_t *p = luaL_checkudata( L, 1, PROCESS_POLLER_MT );
+
+    lua_pushinteger( L, p->nused );
+
+    return 1;
+}
+
+
+static int fd_lua( lua_State *L )
+{
+    ppoller_t *p = luaL_checkudata( L, 1, PROCESS_POLLER_MT );
+
+    lua_pushinteger( L, p->epfd );
+
+    return 1;
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    ppoller_t *p = lua_touserdata( L, 1 );
+    int i = 0;
+
+    if( p->slots )
+    {
+        for(; i < p->nslot; i++ )
+        {
+            if( p->slots[i].chd ){
+                luaL_unref( L, LUA_REGISTRYINDEX, p->slots[i].ref );
+            }
+        }
+        free( (void*)p->slots );
+    }
+    if( p->evs ){
+        free( (void*)p->evs );
+    }
+    luaL_unref( L, LUA_REGISTRYINDEX, p->mapref );
+    if( p->epfd != -1 ){
+        close( p->epfd );
+    }
+
+    return 0;
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    lua_pushfstring( L, PROCESS_POLLER_MT ": %p", lua_touserdata( L, 1 ) );
+    return 1;
+}
+
+#endif
+
+
+static int new_lua( lua_State *L )
+{
+#if defined(__linux__)
+    lua_Integer maxevents = luaL_optinteger( L, 1, POLLER_MAXEVENTS );
+    ppoller_t *p = NULL;
+
+    luaL_argcheck( L, maxevents > 0 && maxevents <= INT32_MAX / 2, 1,
+                   "maxevents must be greater than 0" );
+    p = lua_newuserdata( L, sizeof( ppoller_t ) );
+    *p = (ppoller_t){
+        .epfd = -1,
+        .maxevents = (int)maxevents,
+        .evs = NULL,
+        .nslot = 0,
+        .nused = 0,
+        .freeslot = -1,
+        .slots = NULL,
+        .mapref = LUA_NOREF
+    };
+    luaL_getmetatable( L, PROCESS_POLLER_MT );
+    lua_setmetatable( L, -2 );
+    lua_newtable( L );
+    p->mapref = luaL_ref( L, LUA_REGISTRYINDEX );
+
+    if( ( p->evs = malloc( sizeof( struct epoll_event ) * maxevents ) ) &&
+        ( p->epfd = epoll_create1( EPOLL_CLOEXEC ) ) != -1 ){
+        return 1;
+    }
+#else
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+LUALIB_API int luaopen_process_poller( lua_State *L )
+{
+#if defined(__linux__)
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "add", add_lua },
+        { "del", del_lua },
+        { "wait", wait_lua },
+        { "len", len_lua },
+        { "fd", fd_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg *ptr = mmethod;
+
+    // create metatable
+    luaL_newmetatable( L, PROCESS_POLLER_MT );
+    // metamethods
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    // methods
+    lua_pushstring( L, "__index" );
+    lua_newtable( L );
+    ptr = method;
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    lua_rawset( L, -3 );
+    lua_pop( L, 1 );
+#endif
+
+    // push constructor
+    lua_pushcfunction( L, new_lua );
+
+    return 1;
+}
@@ -0,0 +1,561 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/pool.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+#include <poll.h>
+
+
+typedef struct {
+    pchild_t *chd;
+    // reference of process.child instance
+    int ref;
+    // number of dispatched requests that are not done
+    int depth;
+    // last activity time in msec
+    uint64_t last;
+} pworker_t;
+
+
+typedef struct {
+    pcmd_t cmd;
+    int closed;
+    int min;
+    int max;
+    // idle timeout in msec; 0 means that workers never be shrunk
+    uint64_t idle;
+    int nworker;
+    pworker_t *workers;
+    struct pollfd *pfds;
+    // processes that are not reaped yet
+    int nretired;
+    int maxretired;
+    pid_t *retired;
+} ppool_t;
+
+
+static inline uint64_t getmsec( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+
+static inline pworker_t *getworker( ppool_t *p, pchild_t *chd )
+{
+    int i = 0;
+
+    for(; i < p->nworker; i++ )
+    {
+        if( p->workers[i].chd == chd ){
+            return p->workers + i;
+        }
+    }
+
+    return NULL;
+}
+
+
+static int spawn_worker( lua_State *L, ppool_t *p )
+{
+    ptimings_t t = { .start = getnsec() };
+    iopipe_t iop = iop_no_value;
+    pid_t pid = pcmd_spawn( &p->cmd, &iop, &t );
+    pworker_t *w = p->workers + p->nworker;
+
+    if( pid == -1 ){
+        return -1;
+    }
+
+    newpchild( L, pid, iop.fds[IOP_IN_WRITE], iop.fds[IOP_OUT_READ],
+               iop.fds[IOP_ERR_READ], p->cmd.nonblock, &t );
+    *w = (pworker_t){
+        .chd = lua_touserdata( L, -1 ),
+        .ref = luaL_ref( L, LUA_REGISTRYINDEX ),
+        .depth = 0,
+        .last = getmsec()
+    };
+    p->nworker++;
+
+    return 0;
+}
+
+
+static void reap_retired( ppool_t *p )
+{
+    int i = 0;
+    pid_t rv = 0;
+
+    while( i < p->nretired )
+    {
+        // reaped or no child process
+        if( ( rv = waitpid( p->retired[i], NULL, WNOHANG ) ) != 0 ){
+            if( rv > 0 ){
+                PSTATS.reaped++;
+            }
+            p->retired[i] = p->retired[--p->nretired];
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+
+// remove the worker from the pool and send the signal to it
+static void retire_worker( lua_State *L, ppool_t *p, int idx, int signo )
+{
+    pworker_t *w = p->workers + idx;
+    pid_t pid = w->chd->pid;
+    pid_t rv = 0;
+
+    // close stdin to notify end-of-file to worker
+    if( w->chd->fds[0] != -1 ){
+        close( w->chd->fds[0] );
+        w->chd->fds[0] = -1;
+    }
+    if( signo ){
+        kill( pid, signo );
+    }
+    luaL_unref( L, LUA_REGISTRYINDEX, w->ref );
+    p->workers[idx] = p->workers[--p->nworker];
+
+    if( ( rv = waitpid( pid, NULL, WNOHANG ) ) > 0 ){
+        PSTATS.reaped++;
+    }
+    // reap it later
+    else if( rv == 0 )
+    {
+        if( p->nretired == p->maxretired )
+        {
+            int max = p->maxretired ? p->maxretired * 2 : p->max;
+            pid_t *pids = realloc( p->retired, sizeof( pid_t ) * (size_t)max );
+
+            // give up to reap it
+            if( !pids ){
+                return;
+            }
+            p->retired = pids;
+            p->maxretired = max;
+        }
+        p->retired[p->nretired++] = pid;
+    }
+}
+
+
+// returns 1 if the worker has output that is not read yet
+static inline int hasoutput( pworker_t *w )
+{
+    struct pollfd pfd = {
+        .fd = w->chd->fds[1],
+        .events = POLLIN,
+        .revents = 0
+    };
+
+    return poll( &pfd, 1, 0 ) > 0 && ( pfd.revents & POLLIN );
+}
+
+
+// reap retired processes, shrink idle workers and spawn workers up to min.
+// the worker is idle if no request is queued, its stdout has no pending
+// output, and it has not been active for the idle timeout
+static int maintain( lua_State *L, ppool_t *p )
+{
+    reap_retired( p );
+    if( p->idle && p->nworker > p->min )
+    {
+        uint64_t now = getmsec();
+        int i = p->nworker - 1;
+
+        for(; i >= 0 && p->nworker > p->min; i-- )
+        {
+            if( !p->workers[i].depth &&
+                now - p->workers[i].last >= p->idle &&
+                !hasoutput( p->workers + i ) ){
+                retire_worker( L, p, i, SIGTERM );
+            }
+        }
+    }
+    while( p->nworker < p->min )
+    {
+        if( spawn_worker( L, p ) == -1 ){
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int wait_lua( lua_State *L )
+{
+    ppool_t *p = luaL_checkudata( L, 1, PROCESS_POOL_MT );
+    int msec = (int)luaL_optinteger( L, 2, -1 );
+    int nfd = p->nworker;
+    int nready = 0;
+    uint64_t now = 0;
+    int i = 0;
+
+    if( p->closed ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( EBADF ) );
+        return 2;
+    }
+
+    for(; i < nfd; i++ ){
+        p->pfds[i] = (struct pollfd){
+            .fd = p->workers[i].chd->fds[1],
+            .events = POLLIN,
+            .revents = 0
+        };
+    }
+
+    if( ( nready = poll( p->pfds, (nfds_t)nfd, msec ) ) == -1 ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+
+    // NOTE: workers are removed by swapping with the last one, so iterate
+    // from the end
+    lua_createtable( L, nready, 0 );
+    nready = 0;
+    now = getmsec();
+    for( i = nfd - 1; i >= 0; i-- )
+    {
+        short revents = p->pfds[i].revents;
+
+        // readable stdout is the activity of the worker
+        if( revents & POLLIN ){
+            p->workers[i].last = now;
+            lua_rawgeti( L, LUA_REGISTRYINDEX, p->workers[i].ref );
+            lua_rawseti( L, -2, ++nready );
+        }
+        // worker has been exited
+        else if( revents & ( POLLHUP|POLLERR|POLLNVAL ) ){
+            retire_worker( L, p, i, 0 );
+        }
+    }
+
+    if( maintain( L, p ) == -1 ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+
+    return 1;
+}
+
+
+static int dispatch_lua( lua_State *L )
+{
+    ppool_t *p = luaL_checkudata( L, 1, PROCESS_POOL_MT );
+    pworker_t *w = NULL;
+    size_t len = 0;
+    size_t remain = 0;
+    int i = 0;
+    int rc = 0;
+
+    if( p->closed ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( EBADF ) );
+        return 2;
+    }
+
+    // find the least loaded worker
+    for(; i < p->nworker; i++ )
+    {
+        if( !w || p->workers[i].depth < w->depth )
+        {
+            w = p->workers + i;
+            if( !w->depth ){
+                break;
+            }
+        }
+    }
+    // all workers are busy
+    if( ( !w || w->depth ) && p->nworker < p->max )
+    {
+        if( spawn_worker( L, p ) == 0 ){
+            w = p->workers + p->nworker - 1;
+        }
+        else if( !w ){
+            lua_pushnil( L );
+            lua_pushstring( L, strerror( errno ) );
+            return 2;
+        }
+    }
+
+    // write data to the worker
+    lua_rawgeti( L, LUA_REGISTRYINDEX, w->ref );
+    lua_replace( L, 1 );
+    if( ( rc = pchild_write( L, &len ) ) == 1 ){
+        w->depth++;
+        w->last = getmsec();
+        lua_pushvalue( L, 1 );
+        return 1;
+    }
+
+    // got error: nothing has been written
+    remain = (size_t)lua_tointeger( L, -rc );
+    if( remain == len ){
+        lua_pushnil( L );
+        lua_replace( L, -( rc + 1 ) );
+        return rc;
+    }
+
+    // NOTE: the request has been partially written to the worker, so it is
+    // counted in the depth of the worker and the worker is returned with
+    // the remaining bytes. the caller must write the rest of the data to
+    // the same worker, otherwise the streams of the workers are corrupted.
+    w->depth++;
+    w->last = getmsec();
+    lua_pushvalue( L, 1 );
+    lua_replace( L, -( rc + 1 ) );
+    if( rc == 2 ){
+        lua_pushnil( L );
+    }
+    lua_pushinteger( L, (lua_Integer)remain );
+
+    return 4;
+}
+
+
+static int done_lua( lua_State *L )
+{
+    ppool_t *p = luaL_checkudata( L, 1, PROCESS_POOL_MT );
+    pworker_t *w = getworker( p, luaL_checkudata( L, 2, PROCESS_CHILD_MT ) );
+
+    if( w ){
+        if( w->depth ){
+            w->depth--;
+        }
+        w->last = getmsec();
+    }
+    lua_pushboolean( L, w != NULL );
+
+    return 1;
+}
+
+
+static int depth_lua( lua_State *L )
+{
+    ppool_t *p = luaL_checkudata( L, 1, PROCESS_POOL_MT );
+    pworker_t *w = getworker( p, luaL_checkudata( L, 2, PROCESS_CHILD_MT ) );
+
+    if( w ){
+        lua_pushinteger( L, w->depth );
+    }
+    else {
+        lua_pushnil( L );
+    }
+
+    return 1;
+}
+
+
+static int workers_lua( lua_State *L )
+{
+    ppool_t *p = luaL_checkudata( L, 1, PROCESS_POOL_MT );
+    int i = 0;
+
+    lua_createtable( L, p->nworker, 0 );
+    for(; i < p->nworker; i++ ){
+        lua_rawgeti( L, LUA_REGISTRYINDEX, p->workers[i].ref );
+        lua_rawseti( L, -2, i + 1 );
+    }
+
+    return 1;
+}
+
+
+static int size_lua( lua_State *L )
+{
+    ppool_t *p = luaL_checkudata( L, 1, PROCESS_POOL_MT );
+
+    lua_pushinteger( L, p->nworker );
+
+    return 1;
+}
+
+
+static void close_pool( lua_State *L, ppool_t *p, int signo, int block )
+{
+    p->closed = 1;
+    while( p->nworker ){
+        retire_worker( L, p, p->nworker - 1, signo );
+    }
+    if( block )
+    {
+        int i = 0;
+
+        for(; i < p->nretired; i++ )
+        {
+            if( waitpid( p->retired[i], NULL, 0 ) > 0 ){
+                PSTATS.reaped++;
+            }
+        }
+        p->nretired = 0;
+    }
+    else {
+        reap_retired( p );
+    }
+}
+
+
+static int close_lua( lua_State *L )
+{
+    ppool_t *p = luaL_checkudata( L, 1, PROCESS_POOL_MT );
+    int signo = (int)luaL_optinteger( L, 2, SIGTERM );
+
+    close_pool( L, p, signo, 1 );
+
+    return 0;
+}
+
+
+static int gc_lua( lua_State *L )
+{
+    ppool_t *p = lua_touserdata( L, 1 );
+
+    if( !p->closed ){
+        close_pool( L, p, SIGTERM, 0 );
+    }
+    pcmd_dispose( &p->cmd );
+    if( p->workers ){
+        free( (void*)p->workers );
+    }
+    if( p->pfds ){
+        free( (void*)p->pfds );
+    }
+    if( p->retired ){
+        free( (void*)p->retired );
+    }
+
+    return 0;
+}
+
+
+static int tostring_lua( lua_State *L )
+{
+    lua_pushfstring( L, PROCESS_POOL_MT ": %p", lua_touserdata( L, 1 ) );
+    return 1;
+}
+
+
+static int new_lua( lua_State *L )
+{
+    ppool_t *p = lua_newuserdata( L, sizeof( ppool_t ) );
+    lua_Integer min = 1;
+    lua_Integer max = 1;
+    lua_Integer idle = 0;
+
+    memset( (void*)p, 0, sizeof( ppool_t ) );
+    luaL_getmetatable( L, PROCESS_POOL_MT );
+    lua_setmetatable( L, -2 );
+
+    // check sizes
+    if( lua_type( L, 4 ) == LUA_TTABLE )
+    {
+        min = opt_integer( L, 4, "min", 1 );
+        max = opt_integer( L, 4, "max", min > 1 ? min : 1 );
+        idle = opt_integer( L, 4, "idle", 0 );
+        luaL_argcheck( L, min >= 0, 4, "min must be greater than or equal to 0" );
+        luaL_argcheck( L, max > 0 && max >= min, 4,
+                       "max must be greater than 0 and min" );
+        luaL_argcheck( L, idle >= 0, 4,
+                       "idle must be greater than or equal to 0" );
+    }
+    p->min = (int)min;
+    p->max = (int)max;
+    p->idle = (uint64_t)idle;
+
+    if( pcmd_init( L, &p->cmd, 1 ) == 0 &&
+        ( p->workers = malloc( sizeof( pworker_t ) * (size_t)max ) ) &&
+        ( p->pfds = malloc( sizeof( struct pollfd ) * (size_t)max ) ) )
+    {
+        // requests are written to stdin and responses are read from stdout
+        p->cmd.stdio[STDIN_FILENO] = pstdio_pipe;
+        p->cmd.stdio[STDOUT_FILENO] = pstdio_pipe;
+        if( maintain( L, p ) == 0 ){
+            return 1;
+        }
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+LUALIB_API int luaopen_process_pool( lua_State *L )
+{
+    struct luaL_Reg mmethod[] = {
+        { "__gc", gc_lua },
+        { "__tostring", tostring_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg method[] = {
+        { "dispatch", dispatch_lua },
+        { "done", done_lua },
+        { "wait", wait_lua },
+        { "depth", depth_lua },
+        { "workers", workers_lua },
+        { "size", size_lua },
+        { "close", close_lua },
+        { NULL, NULL }
+    };
+    struct luaL_Reg *ptr = mmethod;
+
+    // create metatable
+    luaL_newmetatable( L, PROCESS_POOL_MT );
+    // metamethods
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    // methods
+    lua_pushstring( L, "__index" );
+    lua_newtable( L );
+    ptr = method;
+    while( ptr->name ){
+        lauxh_pushfn2tbl( L, ptr->name, ptr->func );
+        ptr++;
+    }
+    lua_rawset( L, -3 );
+    lua_pop( L, 1 );
+
+    // push constructor
+    lua_pushcfunction( L, new_lua );
+
+    return 1;
+}
@@ -0,0 +1,1084 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/spawn.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+
+extern char **environ;
+
+// default search path if PATH is not defined in the environment
+#define DEFAULT_PATH    "/usr/bin:/bin"
+
+
+// NOTE: all of the following functions are called in the child process that
+// shares the memory with the parent process after vfork(2).
+// it must not allocate memory, must not modify the global variables and must
+// use only async-signal-safe functions.
+
+static const char *envp_getpath( char *const envp[] )
+{
+    for(; *envp; envp++ )
+    {
+        if( strncmp( *envp, "PATH=", 5 ) == 0 ){
+            return *envp + 5;
+        }
+    }
+
+    return DEFAULT_PATH;
+}
+
+
+static void execsh( const char *file, char *const argv[], char *const envp[] )
+{
+    size_t argc = 0;
+
+    while( argv[argc] ){
+        argc++;
+    }
+
+    // file is not an executable format; execute it by the shell like
+    // execvp(3) does
+    {
+        // NOTE: argv[1..argc] includes the last NULL if argc > 0, but the
+        // last NULL must be added to sargv[2] if argv is empty
+        char *sargv[argc + 3];
+
+        sargv[0] = "/bin/sh";
+        sargv[1] = (char*)file;
+        if( argc ){
+            memcpy( sargv + 2, argv + 1, sizeof( char* ) * argc );
+        }
+        else {
+            sargv[2] = NULL;
+        }
+        execve( sargv[0], sargv, envp );
+    }
+}
+
+
+// execvp(3) that takes the environment array.
+// the search path is taken from the PATH of envp like execvp(3) that called
+// after replacing the environ.
+static void execvpe_r( const char *file, char *const argv[],
+                       char *const envp[] )
+{
+    size_t flen = strlen( file );
+    const char *path = NULL;
+    const char *head = NULL;
+    const char *tail = NULL;
+    int eacces = 0;
+    char buf[PATH_MAX];
+
+    if( !flen ){
+        errno = ENOENT;
+        return;
+    }
+    // pathname
+    else if( strchr( file, '/' ) ){
+        execve( file, argv, envp );
+        if( errno == ENOEXEC ){
+            execsh( file, argv, envp );
+        }
+        return;
+    }
+
+    path = envp_getpath( envp );
+    for( head = path; ; head = tail + 1 )
+    {
+        size_t dlen = 0;
+
+        if( !( tail = strchr( head, ':' ) ) ){
+            tail = head + strlen( head );
+        }
+
+        dlen = (size_t)( tail - head );
+        if( dlen + flen + 2 > sizeof( buf ) ){
+            errno = ENAMETOOLONG;
+        }
+        else
+        {
+            // empty element means the current directory
+            if( dlen ){
+                memcpy( buf, head, dlen );
+                buf[dlen++] = '/';
+            }
+            memcpy( buf + dlen, file, flen + 1 );
+            execve( buf, argv, envp );
+
+            switch( errno ){
+                case ENOEXEC:
+                    execsh( buf, argv, envp );
+                    return;
+
+                // try next path
+                case EACCES:
+                    eacces = 1;
+                case ENOENT:
+                case ENOTDIR:
+                case ENAMETOOLONG:
+                case ELOOP:
+                case ESTALE:
+                case ENODEV:
+                case ETIMEDOUT:
+                break;
+
+                default:
+                    return;
+            }
+        }
+
+        if( !*tail ){
+            break;
+        }
+    }
+
+    if( eacces ){
+        errno = EACCES;
+    }
+}
+
+
+static void reset_sigaction( void )
+{
+    struct sigaction sa;
+    int signo = 1;
+
+    // the child process of vfork(2) must not run the signal handlers of the
+    // parent process since they will modify the memory of the parent process.
+    for(; signo < NSIG; signo++ )
+    {
+        if( sigaction( signo, NULL, &sa ) == 0 &&
+            sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL ){
+            sa.sa_handler = SIG_DFL;
+            sa.sa_flags = 0;
+            sigemptyset( &sa.sa_mask );
+            sigaction( signo, &sa, NULL );
+        }
+    }
+}
+
+
+static int pattr_apply( pattr_t *attr )
+{
+    int i = 0;
+
+    // NOTE: resource limits are set first since RLIMIT_NICE and
+    // RLIMIT_RTPRIO restrict the following attributes
+    for(; attr->userlimit && i < PRLIMIT_MAX; i++ )
+    {
+        if( ( attr->userlimit & ( 1U << i ) ) &&
+            setrlimit( i, attr->rlimits + i ) == -1 ){
+            return -1;
+        }
+    }
+    // NOTE: scheduling policy must be set before the nice value since
+    // SCHED_BATCH and SCHED_IDLE are still affected by the nice value
+    if( attr->usesched ){
+#if defined(__linux__)
+        struct sched_param param = { .sched_priority = attr->schedprio };
+
+        if( sched_setscheduler( 0, attr->sched, &param ) == -1 ){
+            return -1;
+        }
+#else
+        errno = ENOTSUP;
+        return -1;
+#endif
+    }
+    if( attr->usenice && setpriority( PRIO_PROCESS, 0, attr->nice ) == -1 ){
+        return -1;
+    }
+    if( attr->useioprio ){
+#if defined(__linux__)
+        if( ioprio_set_r( IOPRIO_WHO_PROCESS, 0, attr->ioprio ) == -1 ){
+            return -1;
+        }
+#else
+        errno = ENOTSUP;
+        return -1;
+#endif
+    }
+    if( attr->useaffinity ){
+#if defined(__linux__)
+        if( sched_setaffinity( 0, sizeof( cpu_set_t ), &attr->affinity ) == -1 ){
+            return -1;
+        }
+#else
+        errno = ENOTSUP;
+        return -1;
+#endif
+    }
+
+    return 0;
+}
+
+
+#if defined(__linux__)
+// move the calling process to the cgroup
+static int cgroup_enter( int dirfd )
+{
+    int fd = openat( dirfd, "cgroup.procs", O_WRONLY|O_CLOEXEC );
+    ssize_t rv = 0;
+
+    if( fd == -1 ){
+        return -1;
+    }
+    // NOTE: writing 0 moves the writing process
+    while( ( rv = write( fd, "0", 1 ) ) == -1 && errno == EINTR ){}
+    if( rv == -1 ){
+        int err = errno;
+
+        close( fd );
+        errno = err;
+        return -1;
+    }
+    close( fd );
+
+    return 0;
+}
+#endif
+
+
+static int spawn_child( pspawn_t *ps )
+{
+#if defined(__linux__)
+    // move to the cgroup unless the child process is created in it
+    if( ps->cgroupfd != -1 && cgroup_enter( ps->cgroupfd ) == -1 ){
+        return errno;
+    }
+#endif
+    // set process-working-directory
+    if( ps->pwd != NULL && chdir( ps->pwd ) == -1 ){
+        return errno;
+    }
+    // set std-in-out-err
+    else if( iop_set( ps->iop ) != 0 ){
+        return errno;
+    }
+    // NOTE: the parent process can see the timestamps only in vfork mode
+    if( ps->timings ){
+        ps->timings->setup = getnsec();
+    }
+    // set the attributes
+    if( ps->attr && pattr_apply( ps->attr ) == -1 ){
+        return errno;
+    }
+
+    if( ps->timings ){
+        ps->timings->exec = getnsec();
+    }
+    execvpe_r( ps->path, ps->argv, ps->envp ? ps->envp : environ );
+
+    return errno;
+}
+
+
+#if defined(__linux__) && defined(SYS_clone3)
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP   0x200000000ULL
+#endif
+
+// struct clone_args of linux/sched.h
+typedef struct {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+} pclone_args_t;
+
+// set to 1 if clone3(2) with CLONE_INTO_CGROUP is not supported; it
+// requires linux 5.7 or later
+static int NOCLONE3 = 0;
+
+#endif
+
+
+// create the child process by fork(2), or clone(2) in sibling mode
+static pid_t fork_child( pspawn_t *ps )
+{
+#if defined(__linux__)
+
+#if defined(SYS_clone3)
+    if( ps->cgroupfd != -1 && !NOCLONE3 )
+    {
+        // NOTE: exit_signal must be 0 with CLONE_PARENT, then the child
+        // process inherits the exit signal of the calling process
+        pclone_args_t args = {
+            .flags = CLONE_INTO_CGROUP | ( ps->sibling ? CLONE_PARENT : 0 ),
+            .exit_signal = ps->sibling ? 0 : SIGCHLD,
+            .cgroup = (uint64_t)ps->cgroupfd
+        };
+        pid_t pid = (pid_t)syscall( SYS_clone3, &args, sizeof( args ) );
+
+        if( pid == 0 ){
+            // the child process has been created in the cgroup
+            ps->cgroupfd = -1;
+            return 0;
+        }
+        else if( pid != -1 ){
+            return pid;
+        }
+        else if( errno == ENOSYS || errno == E2BIG || errno == EINVAL ){
+            NOCLONE3 = 1;
+        }
+        // fallback to moving the child process to the cgroup by itself
+    }
+#endif
+
+    // NOTE: the child process will be a child of the parent of the calling
+    // process, so SIGCHLD is delivered to it and it can reap the child
+    if( ps->sibling ){
+        return (pid_t)syscall( SYS_clone, CLONE_PARENT|SIGCHLD, NULL, NULL,
+                               NULL, NULL );
+    }
+#endif
+
+    return fork();
+}
+
+
+static pid_t spawn_fork( pspawn_t *ps )
+{
+    int fds[2];
+    pid_t pid = 0;
+    int err = 0;
+    ssize_t len = 0;
+
+    // use a close-on-exec pipe to receive the error of the child process
+    if( pipe( fds ) == -1 ){
+        return -1;
+    }
+    fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+    fcntl( fds[1], F_SETFD, FD_CLOEXEC );
+
+    pid = fork_child( ps );
+    // child
+    if( pid == 0 ){
+        close( fds[0] );
+        err = spawn_child( ps );
+        while( write( fds[1], &err, sizeof( int ) ) == -1 &&
+               errno == EINTR ){}
+        _exit( 127 );
+    }
+    close( fds[1] );
+    // got error
+    if( pid == -1 ){
+        err = errno;
+        close( fds[0] );
+        errno = err;
+        return -1;
+    }
+
+    // wait until the child process executes the file or exits
+    while( ( len = read( fds[0], &err, sizeof( int ) ) ) == -1 &&
+           errno == EINTR ){}
+    close( fds[0] );
+
+    if( len == sizeof( int ) ){
+        if( ps->sibling ){
+            ps->zombie = pid;
+        }
+        else {
+            waitpid( pid, NULL, 0 );
+        }
+        errno = err;
+        return -1;
+    }
+
+    return pid;
+}
+
+
+static pid_t spawn_vfork( pspawn_t *ps )
+{
+    sigset_t all;
+    sigset_t omask;
+    volatile int err = 0;
+    pid_t pid = 0;
+
+    // block all signals until the child process resets the signal handlers
+    sigfillset( &all );
+    sigprocmask( SIG_BLOCK, &all, &omask );
+
+    // NOTE: vfork(2) is clone(2) with CLONE_VM|CLONE_VFORK on linux.
+    // the child process shares the memory with the parent process, so the
+    // cost of vfork(2) does not depend on the size of the parent process.
+    // the parent process is suspended until the child process calls
+    // execve(2) or _exit(2).
+    pid = vfork();
+    // child
+    if( pid == 0 ){
+        reset_sigaction();
+        sigprocmask( SIG_SETMASK, &omask, NULL );
+        // the parent process can see this value
+        err = spawn_child( ps );
+        _exit( 127 );
+    }
+    else if( pid == -1 ){
+        err = errno;
+    }
+    // child process failed to execute the file
+    else if( err ){
+        waitpid( pid, NULL, 0 );
+        pid = -1;
+    }
+    sigprocmask( SIG_SETMASK, &omask, NULL );
+
+    if( pid == -1 ){
+        errno = err;
+    }
+
+    return pid;
+}
+
+
+// MARK: executable cache
+#define EXECCACHE_SIZE  64
+
+typedef struct {
+    // file name and search path that joined by NUL; NULL if unused
+    char *key;
+    size_t klen;
+    // resolved absolute pathname
+    char *path;
+    // attributes to validate the resolved file
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    off_t size;
+} pexec_t;
+
+static pexec_t EXECCACHE[EXECCACHE_SIZE];
+static uint64_t EXECCACHE_HIT = 0;
+static uint64_t EXECCACHE_MISS = 0;
+
+
+static inline void execcache_clear( pexec_t *e )
+{
+    if( e->key ){
+        free( (void*)e->key );
+        free( (void*)e->path );
+        e->key = e->path = NULL;
+    }
+}
+
+
+static inline int isexecutable( const char *path, struct stat *st )
+{
+    return stat( path, st ) == 0 && S_ISREG( st->st_mode ) &&
+           access( path, X_OK ) == 0;
+}
+
+
+// resolve the file name to the absolute pathname with the search path and
+// set the cached pathname to *path, or NULL if it cannot be resolved in the
+// parent process. the child process searches the file by itself in that case.
+// returns -1 with ENOENT or EACCES if the file is not found in the search
+// path, so the child process does not search it again.
+static int execcache_resolve( const char *file, char *const envp[],
+                              const char **path )
+{
+    const char *search = envp_getpath( envp );
+    size_t flen = strlen( file );
+    size_t slen = strlen( search );
+    size_t klen = flen + 1 + slen;
+    uint64_t hash = 14695981039346656037ULL;
+    const char *head = NULL;
+    const char *tail = NULL;
+    pexec_t *e = NULL;
+    size_t i = 0;
+    int err = ENOENT;
+    struct stat st;
+    char buf[PATH_MAX];
+
+    *path = NULL;
+    if( !flen || strchr( file, '/' ) ){
+        return 0;
+    }
+    // the relative directory depends on the working directory of the child
+    // process, so check it before searching to not search twice
+    for( head = search; ; head = tail + 1 )
+    {
+        if( !( tail = strchr( head, ':' ) ) ){
+            tail = head + strlen( head );
+        }
+        if( tail == head || *head != '/' ){
+            return 0;
+        }
+        else if( !*tail ){
+            break;
+        }
+    }
+
+    // FNV-1a hash of file name and search path
+    for(; i < flen; i++ ){
+        hash = ( hash ^ (unsigned char)file[i] ) * 1099511628211ULL;
+    }
+    for( i = 0; i < slen; i++ ){
+        hash = ( hash ^ (unsigned char)search[i] ) * 1099511628211ULL;
+    }
+    e = EXECCACHE + ( hash % EXECCACHE_SIZE );
+
+    // validate the cached file
+    if( e->key && e->klen == klen && memcmp( e->key, file, flen + 1 ) == 0 &&
+        memcmp( e->key + flen + 1, search, slen ) == 0 )
+    {
+        if( isexecutable( e->path, &st ) && st.st_dev == e->dev &&
+            st.st_ino == e->ino && st.st_mtime == e->mtime &&
+            st.st_size == e->size ){
+            EXECCACHE_HIT++;
+            *path = e->path;
+            return 0;
+        }
+    }
+    EXECCACHE_MISS++;
+    execcache_clear( e );
+
+    // search the file
+    for( head = search; ; head = tail + 1 )
+    {
+        size_t dlen = 0;
+
+        if( !( tail = strchr( head, ':' ) ) ){
+            tail = head + strlen( head );
+        }
+        dlen = (size_t)( tail - head );
+        if( dlen + flen + 2 <= sizeof( buf ) )
+        {
+            memcpy( buf, head, dlen );
+            buf[dlen++] = '/';
+            memcpy( buf + dlen, file, flen + 1 );
+            if( isexecutable( buf, &st ) ){
+                break;
+            }
+            // found but cannot be executed; continue searching like
+            // execvp(3)
+            else if( errno != ENOENT && errno != ENOTDIR ){
+                err = EACCES;
+            }
+        }
+
+        // not found
+        if( !*tail ){
+            errno = err;
+            return -1;
+        }
+    }
+
+    // save the resolved pathname.
+    // NOTE: the child process searches the file again if it cannot be saved
+    if( !( e->key = malloc( klen ) ) ){
+        return 0;
+    }
+    else if( !( e->path = strdup( buf ) ) ){
+        free( (void*)e->key );
+        e->key = NULL;
+        return 0;
+    }
+    memcpy( e->key, file, flen + 1 );
+    memcpy( e->key + flen + 1, search, slen );
+    e->klen = klen;
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->mtime = st.st_mtime;
+    e->size = st.st_size;
+    *path = e->path;
+
+    return 0;
+}
+
+
+int execcache_lua( lua_State *L )
+{
+    int n = 0;
+    int i = 0;
+
+    lua_createtable( L, 0, 3 );
+    lua_pushstring( L, "hit" );
+    lua_pushinteger( L, (lua_Integer)EXECCACHE_HIT );
+    lua_rawset( L, -3 );
+    lua_pushstring( L, "miss" );
+    lua_pushinteger( L, (lua_Integer)EXECCACHE_MISS );
+    lua_rawset( L, -3 );
+
+    // cached entries
+    lua_pushstring( L, "entries" );
+    lua_newtable( L );
+    for(; i < EXECCACHE_SIZE; i++ )
+    {
+        pexec_t *e = EXECCACHE + i;
+
+        if( e->key ){
+            size_t flen = strlen( e->key );
+
+            lua_createtable( L, 0, 3 );
+            lua_pushstring( L, "name" );
+            lua_pushlstring( L, e->key, flen );
+            lua_rawset( L, -3 );
+            lua_pushstring( L, "search" );
+            lua_pushlstring( L, e->key + flen + 1, e->klen - flen - 1 );
+            lua_rawset( L, -3 );
+            lua_pushstring( L, "path" );
+            lua_pushstring( L, e->path );
+            lua_rawset( L, -3 );
+            lua_rawseti( L, -2, ++n );
+        }
+    }
+    lua_rawset( L, -3 );
+
+    return 1;
+}
+
+
+int flushexeccache_lua( lua_State *L )
+{
+    int i = 0;
+
+    (void)L;
+    for(; i < EXECCACHE_SIZE; i++ ){
+        execcache_clear( EXECCACHE + i );
+    }
+    EXECCACHE_HIT = 0;
+    EXECCACHE_MISS = 0;
+
+    return 0;
+}
+
+
+pid_t pspawn( pspawn_t *ps )
+{
+    const char *file = ps->path;
+    const char *path = NULL;
+    int notfound = execcache_resolve( file, ps->envp ? ps->envp : environ,
+                                      &path );
+    pid_t pid = 0;
+
+    ps->zombie = 0;
+    ps->cgroupfd = -1;
+    // execute the resolved pathname without searching
+    if( path ){
+        ps->path = path;
+    }
+    if( ps->timings ){
+        ps->timings->fork = getnsec();
+    }
+
+    if( ps->cgroup && !notfound ){
+#if defined(__linux__)
+        ps->cgroupfd = open( ps->cgroup, O_RDONLY|O_DIRECTORY|O_CLOEXEC );
+#else
+        errno = ENOTSUP;
+#endif
+    }
+
+    // the file is not found in the search path
+    if( notfound ){
+        pid = -1;
+    }
+    else if( ps->cgroup && ps->cgroupfd == -1 ){
+        pid = -1;
+    }
+    else if( ps->usefork || ps->sibling ){
+        pid = spawn_fork( ps );
+    }
+    else {
+        // NOTE: clone3(2) cannot be used in vfork mode since the child
+        // process would share the stack of the calling process
+        pid = spawn_vfork( ps );
+    }
+    ps->path = file;
+    if( ps->cgroupfd != -1 ){
+        int err = errno;
+
+        close( ps->cgroupfd );
+        ps->cgroupfd = -1;
+        errno = err;
+    }
+
+    PSTATS.spawn++;
+    if( pid == -1 ){
+        PSTATS.spawnfail++;
+        pstats_error( errno );
+    }
+
+    return pid;
+}
+
+
+// MARK: child attributes
+void pattr_check( lua_State *L, int idx, pattr_t *attr )
+{
+    memset( (void*)attr, 0, sizeof( pattr_t ) );
+    if( lua_type( L, idx ) != LUA_TTABLE ){
+        return;
+    }
+
+    // resource limits
+    lua_getfield( L, idx, "rlimits" );
+    if( !lua_isnil( L, -1 ) )
+    {
+        int tbl = lua_gettop( L );
+
+        if( lua_type( L, tbl ) != LUA_TTABLE ){
+            luaL_argerror( L, idx, "rlimits must be table" );
+        }
+        lua_pushnil( L );
+        while( lua_next( L, tbl ) != 0 )
+        {
+            lua_Integer res = -1;
+            struct rlimit *rlim = NULL;
+
+            if( lua_type( L, -2 ) != LUA_TNUMBER ||
+                ( res = lua_tointeger( L, -2 ) ) < 0 || res >= PRLIMIT_MAX ){
+                luaL_argerror( L, idx, "rlimits key must be RLIMIT_* constant" );
+            }
+            rlim = attr->rlimits + res;
+            // soft and hard limits
+            if( lua_type( L, -1 ) == LUA_TTABLE ){
+                lua_rawgeti( L, -1, 1 );
+                rlim->rlim_cur = checkrlim( L, -1, idx );
+                lua_rawgeti( L, -2, 2 );
+                rlim->rlim_max = checkrlim( L, -1, idx );
+                lua_pop( L, 2 );
+            }
+            // same value for both limits
+            else {
+                rlim->rlim_cur = rlim->rlim_max = checkrlim( L, -1, idx );
+            }
+            attr->userlimit |= 1U << res;
+            lua_pop( L, 1 );
+        }
+    }
+    lua_pop( L, 1 );
+
+    // scheduling policy and static priority
+    lua_getfield( L, idx, "sched" );
+    if( !lua_isnil( L, -1 ) ){
+        attr->usesched = 1;
+        attr->sched = (int)opt_integer( L, idx, "sched", 0 );
+        attr->schedprio = (int)opt_integer( L, idx, "schedprio", 0 );
+    }
+    lua_pop( L, 1 );
+
+    // nice value
+    lua_getfield( L, idx, "nice" );
+    if( !lua_isnil( L, -1 ) ){
+        attr->usenice = 1;
+        attr->nice = (int)opt_integer( L, idx, "nice", 0 );
+    }
+    lua_pop( L, 1 );
+
+    // i/o scheduling class and priority
+    lua_getfield( L, idx, "ioclass" );
+    if( !lua_isnil( L, -1 ) )
+    {
+        // the priority level defaults to 4 as well as ionice(1)
+        lua_Integer cls = opt_integer( L, idx, "ioclass", 0 );
+        lua_Integer lv = opt_integer( L, idx, "iolevel", 4 );
+
+        luaL_argcheck( L, cls >= 0 && cls <= 3, idx,
+                       "ioclass must be IOPRIO_CLASS_* constant" );
+        luaL_argcheck( L, lv >= 0 && lv <= 7, idx,
+                       "iolevel must be in range 0-7" );
+        attr->useioprio = 1;
+#if defined(__linux__)
+        attr->ioprio = PIOPRIO_VALUE( (int)cls, (int)lv );
+#endif
+    }
+    lua_pop( L, 1 );
+
+    // cpu affinity
+    lua_getfield( L, idx, "affinity" );
+    if( !lua_isnil( L, -1 ) )
+    {
+        if( lua_type( L, -1 ) != LUA_TTABLE ){
+            luaL_argerror( L, idx, "affinity must be array of cpu number" );
+        }
+        attr->useaffinity = 1;
+#if defined(__linux__)
+        checkcpuset( L, lua_gettop( L ), &attr->affinity, idx );
+#endif
+    }
+    lua_pop( L, 1 );
+}
+
+
+// MARK: spawn attributes
+#define argerror(L,idx,msg) do {        \
+    luaL_argerror( L, idx, msg );       \
+    return -1;                          \
+}while(0)
+
+
+static inline const char *tostr( lua_State *L, int idx, size_t *len )
+{
+    switch( lua_type( L, idx ) ){
+        case LUA_TSTRING:
+        case LUA_TNUMBER:
+            return lua_tolstring( L, idx, len );
+
+        case LUA_TBOOLEAN:
+            if( lua_toboolean( L, idx ) ){
+                *len = 4;
+                return "true";
+            }
+            *len = 5;
+            return "false";
+
+        default:
+            return NULL;
+    }
+}
+
+
+static inline char *strcopy( char **dest, const char *src, size_t len )
+{
+    char *str = *dest;
+
+    memcpy( str, src, len );
+    str[len] = 0;
+    *dest += len + 1;
+
+    return str;
+}
+
+
+int pcmd_init( lua_State *L, pcmd_t *cmd, int idx )
+{
+    int argv = idx + 1;
+    int env = idx + 2;
+    int opts = idx + 3;
+    size_t argc = 1;
+    size_t envc = 0;
+    size_t size = 0;
+    size_t len = 0;
+    const char *str = luaL_checklstring( L, idx, &len );
+    char *ptr = NULL;
+    int i = 0;
+
+    *cmd = (pcmd_t){
+        .path = NULL,
+        .argc = 0,
+        .argv = NULL,
+        .envp = NULL,
+        .pwd = NULL,
+        .cgroup = NULL,
+        .stdio = { pstdio_pipe, pstdio_pipe, pstdio_pipe },
+        .nonblock = 0,
+        .pipesize = 0,
+        .usefork = 0,
+        .mem = NULL
+    };
+
+    // calculate the size of memory block
+    size = len + 1;
+    // check argv
+    if( !lua_isnoneornil( L, argv ) )
+    {
+        luaL_checktype( L, argv, LUA_TTABLE );
+        lua_rawgeti( L, argv, (int)argc );
+        while( !lua_isnil( L, -1 ) )
+        {
+            if( !tostr( L, -1, &len ) ){
+                argerror( L, argv, "argv must be array of string" );
+            }
+            size += len + 1;
+            lua_pop( L, 1 );
+            lua_rawgeti( L, argv, (int)++argc );
+        }
+        lua_pop( L, 1 );
+    }
+    // check env
+    if( !lua_isnoneornil( L, env ) )
+    {
+        luaL_checktype( L, env, LUA_TTABLE );
+        lua_pushnil( L );
+        while( lua_next( L, env ) != 0 )
+        {
+            if( lua_type( L, -2 ) != LUA_TSTRING ){
+                argerror( L, env, "env must be pair table" );
+            }
+            lua_tolstring( L, -2, &len );
+            size += len + 1;
+            if( !tostr( L, -1, &len ) ){
+                argerror( L, env, "env must be pair table" );
+            }
+            size += len + 1;
+            envc++;
+            lua_pop( L, 1 );
+        }
+        // NULL terminated array
+        size += sizeof( char* ) * ( envc + 1 );
+    }
+    // check options
+    if( !lua_isnoneornil( L, opts ) )
+    {
+        luaL_checktype( L, opts, LUA_TTABLE );
+        if( ( str = opt_string( L, opts, "cwd", NULL ) ) ){
+            size += strlen( str ) + 1;
+        }
+        if( ( str = opt_string( L, opts, "cgroup", NULL ) ) ){
+            size += strlen( str ) + 1;
+        }
+        cmd->nonblock = opt_boolean( L, opts, "nonblock", 0 );
+        cmd->pipesize = iop_checkpipesize( L, opts );
+        cmd->usefork = opt_boolean( L, opts, "fork", 0 );
+        iop_checkstdio( L, opts, cmd->stdio );
+        pattr_check( L, opts, &cmd->attr );
+        for( i = 0; i < 3; i++ )
+        {
+            if( cmd->stdio[i].type == PSTDIO_FILE ){
+                size += strlen( cmd->stdio[i].path ) + 1;
+            }
+        }
+    }
+    // NULL terminated array
+    size += sizeof( char* ) * ( argc + 1 );
+
+    if( !( cmd->mem = malloc( size ) ) ){
+        return -1;
+    }
+
+    // arrays are placed at the head of memory block
+    cmd->argv = (char**)cmd->mem;
+    ptr = (char*)( cmd->argv + argc + 1 );
+    // NOTE: empty env table means the empty environment like exec
+    if( envc || !lua_isnoneornil( L, env ) ){
+        cmd->envp = (char**)ptr;
+        ptr = (char*)( cmd->envp + envc + 1 );
+    }
+
+    // copy strings
+    str = lua_tolstring( L, idx, &len );
+    cmd->path = cmd->argv[0] = strcopy( &ptr, str, len );
+    for( i = 1; (size_t)i < argc; i++ ){
+        lua_rawgeti( L, argv, i );
+        str = tostr( L, -1, &len );
+        cmd->argv[i] = strcopy( &ptr, str, len );
+        lua_pop( L, 1 );
+    }
+    cmd->argv[argc] = NULL;
+    cmd->argc = argc;
+
+    if( cmd->envp )
+    {
+        char **envp = cmd->envp;
+
+        lua_pushnil( L );
+        while( lua_next( L, env ) != 0 )
+        {
+            *envp = ptr;
+            str = lua_tolstring( L, -2, &len );
+            memcpy( ptr, str, len );
+            ptr[len] = '=';
+            ptr += len + 1;
+            str = tostr( L, -1, &len );
+            strcopy( &ptr, str, len );
+            envp++;
+            lua_pop( L, 1 );
+        }
+        *envp = NULL;
+    }
+
+    if( !lua_isnoneornil( L, opts ) )
+    {
+        if( ( str = opt_string( L, opts, "cwd", NULL ) ) ){
+            cmd->pwd = strcopy( &ptr, str, strlen( str ) );
+        }
+        if( ( str = opt_string( L, opts, "cgroup", NULL ) ) ){
+            cmd->cgroup = strcopy( &ptr, str, strlen( str ) );
+        }
+        for( i = 0; i < 3; i++ )
+        {
+            if( cmd->stdio[i].type == PSTDIO_FILE ){
+                str = cmd->stdio[i].path;
+                cmd->stdio[i].path = strcopy( &ptr, str, strlen( str ) );
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+void pcmd_dispose( pcmd_t *cmd )
+{
+    if( cmd->mem ){
+        free( (void*)cmd->mem );
+        cmd->mem = NULL;
+    }
+}
+
+
+pid_t pcmd_spawn( pcmd_t *cmd, iopipe_t *iop, ptimings_t *t )
+{
+    pspawn_t ps = {
+        .path = cmd->path,
+        .argv = cmd->argv,
+        .envp = cmd->envp,
+        .pwd = cmd->pwd,
+        .iop = iop,
+        .usefork = cmd->usefork,
+        .timings = t,
+        .attr = &cmd->attr,
+        .cgroup = cmd->cgroup
+    };
+    pid_t pid = -1;
+
+    if( iop_init( iop, cmd->stdio ) == 0 )
+    {
+        if( ( !cmd->nonblock || iop_setnonblock( iop ) == 0 ) &&
+            ( !cmd->pipesize ||
+              iop_setpipesize( iop, cmd->pipesize ) == 0 ) &&
+            ( pid = pspawn( &ps ) ) != -1 ){
+            iop_unset( iop );
+            return pid;
+        }
+        else {
+            int err = errno;
+
+            iop_dispose( iop );
+            errno = err;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (C) 2014 Masatoshi Teruya
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ *
+ *  src/stats.c
+ *  lua-process
+ *
+ *  Created by Masatoshi Teruya on 26/10/17.
+ *
+ */
+
+#include "lprocess.h"
+
+
+pstats_t PSTATS;
+
+
+static inline void setcounter( lua_State *L, const char *k, uint64_t v )
+{
+    lua_pushstring( L, k );
+    lua_pushinteger( L, (lua_Integer)v );
+    lua_rawset( L, -3 );
+}
+
+
+int stats_lua( lua_State *L )
+{
+    int i = 0;
+
+    // use the passed table
+    if( lua_type( L, 1 ) == LUA_TTABLE ){
+        lua_settop( L, 1 );
+    }
+    else {
+        lua_createtable( L, 0, 12 );
+    }
+    setcounter( L, "spawn", PSTATS.spawn );
+    setcounter( L, "spawnfail", PSTATS.spawnfail );
+    setcounter( L, "fork", PSTATS.fork );
+    setcounter( L, "forkfail", PSTATS.forkfail );
+    setcounter( L, "written", PSTATS.written );
+    setcounter( L, "read", PSTATS.read );
+    setcounter( L, "eagain", PSTATS.eagain );
+    setcounter( L, "reaped", PSTATS.reaped );
+    setcounter( L, "live", PSTATS.live );
+    setcounter( L, "pinned", PSTATS.pinned );
+
+    // failures by errno; reuse the existing table
+    lua_pushstring( L, "errors" );
+    lua_rawget( L, -2 );
+    if( !lua_istable( L, -1 ) ){
+        lua_pop( L, 1 );
+        lua_newtable( L );
+        lua_pushstring( L, "errors" );
+        lua_pushvalue( L, -2 );
+        lua_rawset( L, -4 );
+    }
+    for(; i < PSTATS_NERRNO; i++ )
+    {
+        if( PSTATS.errors[i] ){
+            lua_pushinteger( L, (lua_Integer)PSTATS.errors[i] );
+            lua_rawseti( L, -2, i );
+            continue;
+        }
+        // remove the counter that has been reset
+        lua_rawgeti( L, -1, i );
+        if( lua_isnil( L, -1 ) ){
+            lua_pop( L, 1 );
+        }
+        else {
+            lua_pop( L, 1 );
+            lua_pushnil( L );
+            lua_rawseti( L, -2, i );
+        }
+    }
+    lua_pop( L, 1 );
+
+    return 1;
+}
+
+
+int resetstats_lua( lua_State *L )
+{
+    // live instances and pinned data are not event counters
+    uint64_t live = PSTATS.live;
+    uint64_t pinned = PSTATS.pinned;
+
+    (void)L;
+    memset( (void*)&PSTATS, 0, sizeof( pstats_t ) );
+    PSTATS.live = live;
+    PSTATS.pinned = pinned;
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+local process = require('process');
+local exec = process.exec;
+local cpus, ok, err, child, stat, out;
+
+cpus = ifNil( process.getaffinity() );
+ifEqual( #cpus, 0 );
+ifNotEqual( #ifNil( process.getaffinity( process.getpid() ) ), #cpus );
+
+-- set to the calling process
+ifNotTrue( process.setaffinity( 0, { cpus[1] } ) );
+ifNotEqual( #ifNil( process.getaffinity() ), 1 );
+ifNotTrue( process.setaffinity( nil, cpus ) );
+ifNotEqual( #ifNil( process.getaffinity() ), #cpus );
+-- invalid cpus
+ok, err = process.setaffinity( 0, {} );
+ifNotFalse( ok );
+ifNil( err );
+ifTrue( pcall( process.setaffinity, 0, { 'a' } ) );
+ifTrue( pcall( process.setaffinity, 0, { -1 } ) );
+
+-- set to the child process
+child = ifNil( exec( 'sleep', { '1' } ) );
+ifNotTrue( process.setaffinity( child:pid(), { cpus[#cpus] } ) );
+cpus = ifNil( process.getaffinity( child:pid() ) );
+ifNotEqual( #cpus, 1 );
+child:kill();
+child:wait();
+
+-- affinity option
+cpus = process.getaffinity();
+for _, fork in ipairs({ false, true }) do
+    child = ifNil( exec( 'grep', { 'Cpus_allowed_list', '/proc/self/status' }, nil, {
+        fork = fork,
+        affinity = { cpus[1] }
+    }));
+    out = ifNil( child:readall( 'stdout' ) );
+    ifNil( out:find( '%s' .. cpus[1] .. '\n$' ) );
+    stat = ifNil( child:wait() );
+    ifNotEqual( stat.exit, 0 );
+end
+-- the calling process is not affected
+ifNotEqual( #ifNil( process.getaffinity() ), #cpus );
+-- invalid option
+ifTrue( pcall( exec, 'true', nil, nil, { affinity = 0 } ) );
+ifTrue( pcall( exec, 'true', nil, nil, { affinity = { 'a' } } ) );
+-- command
+child = ifNil( ifNil( process.command( 'true', nil, nil, {
+    affinity = { cpus[1] }
+} ) ):spawn() );
+ifNotEqual( ifNil( child:wait() ).exit, 0 );
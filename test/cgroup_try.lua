@@ -0,0 +1,65 @@
+local process = require('process');
+local exec = process.exec;
+-- writable cgroup v2 directory that is delegated to the test user
+local base = os.getenv('LUA_PROCESS_CGROUP');
+local path, ok, err, child, out, stat;
+
+if not base then
+    return;
+end
+path = base .. '/lua-process-test';
+
+-- create leaf cgroup
+ifNotTrue( process.mkcgroup( path, {
+    ['cgroup.max.descendants'] = 0
+}));
+-- existing cgroup
+ifNotTrue( process.mkcgroup( path ) );
+-- invalid limits
+ifTrue( pcall( process.mkcgroup, path, { 'max' } ) );
+ifTrue( pcall( process.mkcgroup, path, { ['../cpu.max'] = 'max' } ) );
+ifTrue( pcall( process.mkcgroup, path, { ['cpu.max'] = true } ) );
+-- unknown interface file: the created cgroup is removed
+ok, err = process.mkcgroup( path .. '-unknown', { ['unknown.max'] = 1 } );
+ifNotFalse( ok );
+ifNil( err );
+ok, err = process.rmcgroup( path .. '-unknown' );
+ifNotFalse( ok );
+ifNil( err );
+
+-- spawn into the cgroup
+for _, fork in ipairs({ false, true }) do
+    child = ifNil( exec( 'grep', { '^0::', '/proc/self/cgroup' }, nil, {
+        fork = fork,
+        cgroup = path
+    }));
+    out = ifNil( child:readall( 'stdout' ) );
+    ifNil( out:find( '/lua-process-test\n$' ) );
+    ifNotEqual( ifNil( child:wait() ).exit, 0 );
+end
+-- command
+child = ifNil( ifNil( process.command( 'true', nil, nil, {
+    cgroup = path
+} ) ):spawn() );
+ifNotEqual( ifNil( child:wait() ).exit, 0 );
+-- not exists
+child, err = exec( 'true', nil, nil, { cgroup = path .. '-noent' } );
+ifNotNil( child );
+ifNil( err );
+ifTrue( pcall( exec, 'true', nil, nil, { cgroup = 1 } ) );
+
+-- usage
+stat = ifNil( process.cgroupstat( path ) );
+ifNotEqual( type( ifNil( stat.cpu ).usage_usec ), 'number' );
+if stat.memory then
+    ifNotEqual( type( stat.memory.current ), 'number' );
+end
+stat, err = process.cgroupstat( path .. '-noent' );
+ifNotNil( stat );
+ifNil( err );
+
+-- remove
+ifNotTrue( process.rmcgroup( path ) );
+ok, err = process.rmcgroup( path );
+ifNotFalse( ok );
+ifNil( err );
@@ -0,0 +1,45 @@
+local process = require('process');
+local clock = process.clock;
+local clocksleep = process.clocksleep;
+local t1, t2, rem, err, deadline;
+
+-- clocks
+t1 = ifNil( clock() );
+t2 = ifNil( clock( process.CLOCK_MONOTONIC ) );
+ifTrue( t2 < t1 );
+ifNil( clock( process.CLOCK_REALTIME ) );
+ifNil( clock( process.CLOCK_PROCESS_CPUTIME_ID ) );
+ifNil( clock( process.CLOCK_THREAD_CPUTIME_ID ) );
+if process.CLOCK_BOOTTIME then
+    ifNil( clock( process.CLOCK_BOOTTIME ) );
+end
+if process.CLOCK_MONOTONIC_COARSE then
+    ifNil( clock( process.CLOCK_MONOTONIC_COARSE ) );
+end
+-- invalid clock
+t1, err = clock( -100 );
+ifNotNil( t1 );
+ifNil( err );
+
+-- relative sleep
+t1 = clock();
+ifNotEqual( clocksleep( 10000000 ), 0 );
+ifTrue( clock() - t1 < 10000000 );
+
+-- absolute sleep
+if process.TIMER_ABSTIME then
+    deadline = clock() + 10000000;
+    for i = 1, 5 do
+        ifNotEqual( clocksleep( deadline, process.CLOCK_MONOTONIC,
+                                process.TIMER_ABSTIME ), 0 );
+        ifTrue( clock() < deadline );
+        deadline = deadline + 10000000;
+    end
+    -- the deadline has already passed
+    t1 = clock();
+    ifNotEqual( clocksleep( t1 - 1000000000, process.CLOCK_MONOTONIC,
+                            process.TIMER_ABSTIME ), 0 );
+end
+
+-- invalid interval
+ifTrue( pcall( clocksleep, -1 ) );
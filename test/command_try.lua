@@ -0,0 +1,48 @@
+local process = require('process');
+local cmd = ifNil( process.command( 'echo', { 'hello' } ) );
+local child, err, stat, argv;
+
+-- arguments
+argv = cmd:argv();
+ifNotEqual( #argv, 2 );
+ifNotEqual( argv[1], 'echo' );
+ifNotEqual( argv[2], 'hello' );
+
+-- spawn repeatedly
+for i = 1, 10 do
+    child = ifNil( cmd:spawn() );
+    ifNotEqual( child:readall( 'stdout' ), 'hello\n' );
+    stat = ifNil( child:wait() );
+    ifNotEqual( stat.exit, 0 );
+end
+
+-- extra arguments
+child = ifNil( cmd:spawn( { 'world', 1 } ) );
+ifNotEqual( child:readall( 'stdout' ), 'hello world 1\n' );
+child:wait();
+-- extra arguments are not retained
+child = ifNil( cmd:spawn( {} ) );
+ifNotEqual( child:readall( 'stdout' ), 'hello\n' );
+child:wait();
+-- invalid extra arguments
+ifTrue( pcall( cmd.spawn, cmd, { {} } ) );
+
+-- env and options
+cmd = ifNil( process.command( 'sh', { '-c', 'echo $FOO; pwd' }, {
+    FOO = 'bar'
+}, {
+    cwd = '/'
+} ) );
+child = ifNil( cmd:spawn() );
+ifNotEqual( child:readall( 'stdout' ), 'bar\n/\n' );
+child:wait();
+
+-- spawn failure
+cmd = ifNil( process.command( './unknown-command' ) );
+child, err = cmd:spawn();
+ifNotNil( child );
+ifNil( err );
+
+-- invalid arguments
+ifTrue( pcall( process.command ) );
+ifTrue( pcall( process.command, 'echo', 'hello' ) );
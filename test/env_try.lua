@@ -0,0 +1,37 @@
+local process = require('process');
+local env, snapshot;
+
+-- single variable
+ifNotEqual( process.getenv( 'PATH' ), os.getenv( 'PATH' ) );
+ifNotNil( process.getenv( 'LUA_PROCESS_TEST_UNDEFINED' ) );
+
+-- setenv
+ifNotTrue( process.setenv( 'LUA_PROCESS_TEST', 'hello' ) );
+ifNotEqual( process.getenv( 'LUA_PROCESS_TEST' ), 'hello' );
+ifNotEqual( os.getenv( 'LUA_PROCESS_TEST' ), 'hello' );
+-- do not overwrite
+ifNotTrue( process.setenv( 'LUA_PROCESS_TEST', 'world', false ) );
+ifNotEqual( process.getenv( 'LUA_PROCESS_TEST' ), 'hello' );
+-- invalid name
+ifNotFalse( process.setenv( 'INVALID=NAME', 'world' ) );
+
+-- all variables
+env = ifNil( process.getenv() );
+ifNotEqual( env.LUA_PROCESS_TEST, 'hello' );
+ifEqual( env, process.getenv() );
+
+-- cached snapshot
+snapshot = ifNil( process.getenv( true ) );
+ifNotEqual( snapshot.LUA_PROCESS_TEST, 'hello' );
+ifNotEqual( snapshot, process.getenv( true ) );
+-- invalidated by setenv
+ifNotTrue( process.setenv( 'LUA_PROCESS_TEST', 'world' ) );
+ifEqual( snapshot, process.getenv( true ) );
+snapshot = process.getenv( true );
+ifNotEqual( snapshot.LUA_PROCESS_TEST, 'world' );
+
+-- unsetenv
+ifNotTrue( process.unsetenv( 'LUA_PROCESS_TEST' ) );
+ifNotNil( process.getenv( 'LUA_PROCESS_TEST' ) );
+ifEqual( snapshot, process.getenv( true ) );
+ifNotNil( process.getenv( true ).LUA_PROCESS_TEST );
@@ -0,0 +1,77 @@
+local process = require('process');
+local exec = process.exec;
+local waitpid = process.waitpid;
+local pathname = os.tmpname();
+local cmd, fdin, fdout, fderr, msg, status;
+
+-- only stdout is redirected to pipe
+cmd = ifNil( exec( 'sh', { '-c', 'echo hello; echo world >&2' }, nil, {
+    stdio = {
+        stdin = 'null',
+        stderr = 'null'
+    }
+}));
+fdin, fdout, fderr = cmd:fds();
+ifNotNil( fdin );
+ifNil( fdout );
+ifNotNil( fderr );
+ifNotEqual( cmd:stdout(), 'hello\n' );
+status = waitpid( cmd:pid() );
+ifNotEqual( status.exit, 0 );
+
+-- merge stderr into stdout
+cmd = ifNil( exec( 'sh', { '-c', 'echo hello >&2' }, nil, {
+    stdio = {
+        stderr = 'stdout'
+    }
+}));
+ifNotEqual( cmd:stdout(), 'hello\n' );
+waitpid( cmd:pid() );
+
+-- redirect to file
+cmd = ifNil( exec( 'sh', { '-c', 'echo hello; echo world >&2' }, nil, {
+    stdio = {
+        stdout = { path = pathname },
+        stderr = { path = pathname, flags = process.O_WRONLY + process.O_APPEND }
+    }
+}));
+waitpid( cmd:pid() );
+msg = io.open( pathname ):read('*a');
+ifNotEqual( msg, 'hello\nworld\n' );
+
+-- redirect from file
+cmd = ifNil( exec( 'cat', nil, nil, {
+    stdio = {
+        stdin = { path = pathname },
+    }
+}));
+ifNotEqual( cmd:stdout(), 'hello\nworld\n' );
+waitpid( cmd:pid() );
+
+-- redirect to existing descriptor
+local cat = ifNil( exec( 'cat' ) );
+fdin = cat:fds();
+cmd = ifNil( exec( 'echo', { 'hello' }, nil, {
+    stdio = {
+        stdout = fdin
+    }
+}));
+waitpid( cmd:pid() );
+ifNotEqual( cat:stdout(), 'hello\n' );
+cat:kill();
+waitpid( cat:pid() );
+os.remove( pathname );
+
+-- inherit all streams
+cmd = ifNil( exec( 'true', nil, nil, {
+    stdio = 'inherit'
+}));
+fdin, fdout, fderr = cmd:fds();
+ifNotNil( fdin );
+ifNotNil( fdout );
+ifNotNil( fderr );
+waitpid( cmd:pid() );
+
+-- invalid option
+ifTrue( pcall( exec, 'echo', nil, nil, { stdio = { stdin = 'stdout' } } ) );
+ifTrue( pcall( exec, 'echo', nil, nil, { stdio = { stdout = 'unknown' } } ) );
@@ -79,3 +79,30 @@ msg = cjson.decode( msg );
 msg = cjson.encode( msg );
 ifNotEqual( cmp, msg );
 
+
+-- with options table
+cmd = ifNil( exec( pathname, argv, env, { nonblock = true, fork = true } ) );
+
+-- send msg: should append LF
+msg = cjson.encode( argv ) .. '\n';
+ifNotEqual( cmd:stdin( msg ), #msg );
+
+-- read json from stdout
+repeat
+    msg, err, again = cmd:stdout();
+until not again;
+ifNil( msg, err );
+msg = cjson.decode( msg );
+msg = cjson.encode( msg );
+ifNotEqual( cmp, msg );
+cmd:kill();
+waitpid( cmd:pid() );
+
+-- failed to execute
+cmd, err = exec( './not_exists' );
+ifNotNil( cmd );
+ifNil( err );
+
+cmd, err = exec( pathname, argv, env, { cwd = './not_exists' } );
+ifNotNil( cmd );
+ifNil( err );
@@ -0,0 +1,61 @@
+local process = require('process');
+local exec = process.exec;
+local info, child, err;
+
+process.flushexeccache();
+info = process.execcache();
+ifNotEqual( info.hit, 0 );
+ifNotEqual( info.miss, 0 );
+ifNotEqual( #info.entries, 0 );
+
+-- resolved and cached
+for i = 1, 3 do
+    child = ifNil( exec( 'echo', { 'hello' }, { PATH = '/usr/bin:/bin' } ) );
+    ifNotEqual( child:readall( 'stdout' ), 'hello\n' );
+    child:wait();
+end
+info = process.execcache();
+ifNotEqual( info.miss, 1 );
+ifNotEqual( info.hit, 2 );
+ifNotEqual( #info.entries, 1 );
+ifNotEqual( info.entries[1].name, 'echo' );
+ifNotEqual( info.entries[1].search, '/usr/bin:/bin' );
+ifNil( info.entries[1].path:find( '^/.+/echo$' ) );
+
+-- different PATH is cached separately
+child = ifNil( exec( 'echo', { 'hello' }, { PATH = '/bin:/usr/bin' } ) );
+child:wait();
+info = process.execcache();
+ifNotEqual( info.miss, 2 );
+
+-- pathname is not cached
+child = ifNil( exec( '/bin/echo', { 'hello' } ) );
+child:wait();
+-- relative directory is not cached
+child = ifNil( exec( 'echo', { 'hello' }, { PATH = 'bin:/usr/bin:/bin' } ) );
+child:wait();
+local found = {};
+for _, e in ipairs( process.execcache().entries ) do
+    ifEqual( e.name, '/bin/echo' );
+    ifEqual( e.search, 'bin:/usr/bin:/bin' );
+    ifNil( e.path:find( '^/.+/echo$' ) );
+    found[e.search] = e.path;
+end
+-- only the entries of absolute search paths
+ifNil( found['/usr/bin:/bin'] );
+ifNil( found['/bin:/usr/bin'] );
+ifNotEqual( #process.execcache().entries, 2 );
+
+-- not found in the search path without searching it again in the child
+info = process.execcache();
+child, err = exec( 'unknown-command-for-test', nil, { PATH = '/usr/bin:/bin' } );
+ifNotNil( child );
+ifNil( err );
+ifNotEqual( process.execcache().miss, info.miss + 1 );
+ifNotEqual( #process.execcache().entries, 2 );
+
+-- flush
+process.flushexeccache();
+info = process.execcache();
+ifNotEqual( #info.entries, 0 );
+ifNotEqual( info.miss, 0 );
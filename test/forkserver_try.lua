@@ -0,0 +1,59 @@
+local process = require('process');
+local waitpid = process.waitpid;
+local fs, err = process.forkserver();
+local cmd, status, data;
+
+-- not supported
+if not fs then
+    ifNil( err );
+    return;
+end
+
+ifNotEqual( type( fs:pid() ), 'number' );
+
+-- grow the heap after the fork server has been created
+data = {};
+for i = 1, 64 do
+    data[i] = ('%08d'):format( i ) .. string.rep( 'x', 1024 * 1024 );
+end
+
+-- the child process is a child of the calling process
+cmd = ifNil( fs:exec( 'echo', { 'hello world' } ) );
+ifNotEqual( cmd:stdout(), 'hello world\n' );
+status = ifNil( waitpid( cmd:pid() ) );
+ifNotEqual( status.pid, cmd:pid() );
+ifNotEqual( status.exit, 0 );
+
+-- with env and stdio options
+cmd = ifNil( fs:exec( 'sh', { '-c', 'echo $HELLO >&2' }, { HELLO = 'world' }, {
+    stdio = {
+        stdin = 'null',
+        stderr = 'stdout'
+    }
+}));
+ifNotNil( cmd:fds() );
+ifNotEqual( cmd:stdout(), 'world\n' );
+waitpid( cmd:pid() );
+
+-- pass existing descriptor
+local cat = ifNil( fs:exec( 'cat' ) );
+cmd = ifNil( fs:exec( 'echo', { 'hello' }, nil, {
+    stdio = {
+        stdout = cat:fds()
+    }
+}));
+waitpid( cmd:pid() );
+ifNotEqual( cat:stdout(), 'hello\n' );
+cat:kill();
+waitpid( cat:pid() );
+
+-- failed to execute
+cmd, err = fs:exec( './not_exists' );
+ifNotNil( cmd );
+ifNil( err );
+
+-- closed
+fs:close();
+cmd, err = fs:exec( 'echo' );
+ifNotNil( cmd );
+ifNil( err );
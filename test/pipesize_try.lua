@@ -0,0 +1,54 @@
+local process = require('process');
+local exec = process.exec;
+local child, size, err, cmd;
+
+-- default capacity
+child = ifNil( exec( 'true' ) );
+ifNotEqual( ifNil( child:pipesize() ), 65536 );
+child:wait();
+
+-- set capacity
+for _, fork in ipairs({ false, true }) do
+    child = ifNil( exec( 'true', nil, nil, {
+        fork = fork,
+        pipesize = 1024 * 1024
+    }));
+    for _, stream in ipairs({ 'stdin', 'stdout', 'stderr' }) do
+        ifNotEqual( ifNil( child:pipesize( stream ) ), 1024 * 1024 );
+    end
+    child:wait();
+end
+
+-- rounded up to a power of two pages
+child = ifNil( exec( 'true', nil, nil, { pipesize = 100000 } ) );
+ifNotEqual( ifNil( child:pipesize() ), 131072 );
+child:wait();
+
+-- capped by pipe-max-size for unprivileged process
+if process.getuid() ~= 0 then
+    child = ifNil( exec( 'true', nil, nil, { pipesize = 1024 * 1024 * 1024 } ) );
+    size = ifNil( child:pipesize() );
+    ifNotEqual( size, tonumber( io.open('/proc/sys/fs/pipe-max-size'):read('*a') ) );
+    child:wait();
+end
+
+-- not redirected to pipe
+child = ifNil( exec( 'true', nil, nil, {
+    pipesize = 1024 * 1024,
+    stdio = { stderr = 'null' }
+}));
+size, err = child:pipesize( 'stderr' );
+ifNotNil( size );
+ifNil( err );
+child:wait();
+-- invalid stream
+ifTrue( pcall( child.pipesize, child, 'unknown' ) );
+-- invalid option
+ifTrue( pcall( exec, 'true', nil, nil, { pipesize = -1 } ) );
+ifTrue( pcall( exec, 'true', nil, nil, { pipesize = 'a' } ) );
+
+-- command
+cmd = ifNil( process.command( 'true', nil, nil, { pipesize = 1024 * 1024 } ) );
+child = ifNil( cmd:spawn() );
+ifNotEqual( ifNil( child:pipesize() ), 1024 * 1024 );
+child:wait();
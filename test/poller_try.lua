@@ -0,0 +1,75 @@
+local process = require('process');
+local exec = process.exec;
+local poller = ifNil( process.poller() );
+local children = {};
+local outputs = {};
+local exited = 0;
+local evs, data;
+
+for i = 1, 10 do
+    children[i] = ifNil( exec( 'sh', { '-c', 'echo ' .. i } ) );
+    ifNotTrue( poller:add( children[i] ) );
+    -- already registered
+    ifNotTrue( poller:add( children[i] ) );
+end
+ifNotEqual( poller:len(), 10 );
+
+while poller:len() > 0 do
+    evs = ifNil( poller:wait( 1000 ) );
+    ifEqual( #evs, 0 );
+    for _, ev in ipairs( evs ) do
+        ifEqual( ev.stream, 'stdin' );
+        if ev.event == 'read' then
+            data = ev.child:read( ev.stream );
+            if data then
+                outputs[ev.child] = ( outputs[ev.child] or '' ) .. data;
+            else
+                poller:del( ev.child, ev.stream );
+            end
+        elseif ev.event == 'exit' then
+            ifNotEqual( ev.stream, 'exit' );
+            ifNotEqual( ifNil( ev.child:wait() ).exit, 0 );
+            exited = exited + 1;
+        else
+            poller:del( ev.child, ev.stream );
+        end
+    end
+end
+
+for i = 1, 10 do
+    ifNotEqual( outputs[children[i]], i .. '\n' );
+end
+if children[1]:pidfd() then
+    ifNotEqual( exited, 10 );
+end
+
+-- timeout
+evs = ifNil( poller:wait( 10 ) );
+ifNotEqual( #evs, 0 );
+
+-- write interest of stdin is registered only if requested
+local child = ifNil( exec( 'cat' ) );
+ifNotTrue( poller:add( child ) );
+evs = ifNil( poller:wait( 10 ) );
+ifNotEqual( #evs, 0 );
+ifNotTrue( poller:add( child, { stdin = true } ) );
+evs = ifNil( poller:wait( 10 ) );
+ifNotEqual( #evs, 1 );
+ifNotEqual( evs[1].stream, 'stdin' );
+ifNotEqual( evs[1].event, 'write' );
+poller:del( child, 'stdin' );
+child:kill();
+child:wait();
+-- slot is reused after remove
+poller:del( child );
+ifNotEqual( poller:len(), 0 );
+for i = 1, 20 do
+    children[i] = ifNil( exec( 'true' ) );
+    ifNotTrue( poller:add( children[i] ) );
+end
+ifNotEqual( poller:len(), 20 );
+for i = 1, 20 do
+    poller:del( children[i] );
+    children[i]:wait();
+end
+ifNotEqual( poller:len(), 0 );
@@ -0,0 +1,79 @@
+local process = require('process');
+local pool = ifNil( process.pool( 'cat', nil, nil, {
+    min = 2,
+    max = 4,
+    idle = 100
+}));
+local worker, workers, pid;
+
+ifNotEqual( pool:size(), 2 );
+
+-- dispatch to idle worker
+worker = ifNil( pool:dispatch( 'hello', '\n' ) );
+ifNotEqual( pool:depth( worker ), 1 );
+workers = ifNil( pool:wait( 1000 ) );
+ifNotEqual( #workers, 1 );
+ifNotEqual( workers[1], worker );
+ifNotEqual( worker:stdout(), 'hello\n' );
+ifNotTrue( pool:done( worker ) );
+ifNotEqual( pool:depth( worker ), 0 );
+
+-- spawn new workers up to max if all workers are busy
+for _ = 1, 6 do
+    ifNil( pool:dispatch( 'hello\n' ) );
+end
+ifNotEqual( pool:size(), 4 );
+for _, w in ipairs( pool:workers() ) do
+    ifNotTrue( pool:depth( w ) > 0 );
+    local len = 0;
+    while len < 6 * pool:depth( w ) do
+        len = len + #ifNil( w:read( 'stdout', 6 * pool:depth( w ) - len ) );
+    end
+    while pool:depth( w ) > 0 do
+        pool:done( w );
+    end
+end
+
+-- shrink idle workers
+process.sleep(1);
+ifNotEqual( #ifNil( pool:wait( 0 ) ), 0 );
+ifNotEqual( pool:size(), 2 );
+
+-- respawn exited worker
+worker = pool:workers()[1];
+pid = worker:pid();
+worker:kill();
+ifNil( pool:wait( 1000 ) );
+ifNotEqual( pool:size(), 2 );
+ifNotNil( pool:depth( worker ) );
+for _, w in ipairs( pool:workers() ) do
+    ifEqual( w:pid(), pid );
+end
+
+-- not a worker
+ifNotFalse( pool:done( ifNil( process.exec( 'true' ) ) ) );
+
+pool:close();
+ifNotEqual( pool:size(), 0 );
+ifNotNil( pool:dispatch( 'hello\n' ) );
+
+-- partially written request in non-blocking mode
+do
+    local p = ifNil( process.pool( 'sleep', { '10' }, nil, { nonblock = true } ) );
+    local data = string.rep( 'x', 1024 * 1024 );
+    local w, err, again, remain = p:dispatch( data );
+
+    ifNil( w );
+    ifNil( err );
+    ifNotTrue( again );
+    ifNotTrue( remain > 0 and remain < #data );
+    ifNotEqual( p:depth( w ), 1 );
+    -- the pipe is full; nothing is written
+    w, err, again, remain = p:dispatch( data );
+    ifNotNil( w );
+    ifNil( err );
+    ifNotTrue( again );
+    ifNotNil( remain );
+    ifNotEqual( p:depth( p:workers()[1] ), 1 );
+    p:close();
+end
@@ -0,0 +1,49 @@
+local process = require('process');
+local exec = process.exec;
+local waitpid = process.waitpid;
+local cmd, msg, err, again, len, buf;
+
+-- read n bytes
+cmd = ifNil( exec( 'echo', { 'hello world' } ) );
+ifNotEqual( cmd:read( 'stdout', 5 ), 'hello' );
+-- returns the rest of data without waiting for n bytes
+ifNotEqual( cmd:read( 'stdout', 100 ), ' world\n' );
+-- end-of-file
+ifNotNil( cmd:read( 'stdout' ) );
+waitpid( cmd:pid() );
+
+-- read all
+cmd = ifNil( exec( 'sh', { '-c', 'yes | head -c 100000 >&2' } ) );
+msg = ifNil( cmd:readall( 'stderr' ) );
+ifNotEqual( #msg, 100000 );
+waitpid( cmd:pid() );
+
+-- read all in non-blocking mode
+cmd = ifNil( exec( 'sleep', { '1' }, nil, { nonblock = true } ) );
+msg, err, again = cmd:readall( 'stdout' );
+ifNotNil( msg );
+ifNil( err );
+ifNotTrue( again );
+waitpid( cmd:pid() );
+
+-- read into buffer
+buf = ifNil( process.buffer() );
+cmd = ifNil( exec( 'sh', { '-c', 'yes | head -c 100000' } ) );
+len = ifNil( cmd:readinto( 'stdout', buf, 10 ) );
+ifNotEqual( len, 10 );
+ifNotEqual( buf:len(), 10 );
+len = ifNil( cmd:readinto( 'stdout', buf ) );
+ifNotEqual( len, 99990 );
+ifNotEqual( buf:len(), 100000 );
+ifNotNil( cmd:readinto( 'stdout', buf ) );
+waitpid( cmd:pid() );
+
+ifNotEqual( buf:peek( 4 ), 'y\ny\n' );
+ifNotEqual( buf:read( 4 ), 'y\ny\n' );
+ifNotEqual( buf:len(), 99996 );
+buf:reset();
+ifNotEqual( buf:len(), 0 );
+ifNotNil( buf:read() );
+
+-- invalid stream
+ifTrue( pcall( cmd.read, cmd, 'stdin' ) );
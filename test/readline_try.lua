@@ -0,0 +1,102 @@
+local process = require('process');
+local exec = process.exec;
+local cmd, line, frame, err, again;
+
+-- read lines
+cmd = ifNil( exec( 'printf', { 'hello\n\nworld\nlast' } ) );
+ifNotEqual( cmd:readline( 'stdout' ), 'hello' );
+ifNotEqual( cmd:readline( 'stdout' ), '' );
+ifNotEqual( cmd:readline( 'stdout' ), 'world' );
+-- last line without newline
+ifNotEqual( cmd:readline( 'stdout' ), 'last' );
+-- end-of-file
+ifNotNil( cmd:readline( 'stdout' ) );
+cmd:wait();
+
+-- long lines
+cmd = ifNil( exec( 'sh', { '-c', 'yes abcdefghij | head -n 100000 | tr -d "\n"; echo; echo end' } ) );
+ifNotEqual( #ifNil( cmd:readline( 'stdout' ) ), 1000000 );
+ifNotEqual( cmd:readline( 'stdout' ), 'end' );
+cmd:wait();
+
+-- too long
+cmd = ifNil( exec( 'printf', { 'hello world\n' } ) );
+line, err = cmd:readline( 'stdout', 5 );
+ifNotNil( line );
+ifNil( err );
+cmd:wait();
+
+-- too long without newline by default
+cmd = ifNil( exec( 'sh', { '-c', 'head -c 20000000 /dev/zero' } ) );
+line, err = cmd:readline( 'stdout' );
+ifNotNil( line );
+ifNil( err );
+cmd:kill();
+cmd:wait();
+
+-- incomplete line in non-blocking mode
+cmd = ifNil( exec( 'sh', { '-c', 'printf foo; sleep 1; echo bar' }, nil, {
+    nonblock = true
+}));
+line, err, again = cmd:readline( 'stdout' );
+ifNotNil( line );
+ifNil( err );
+ifNotTrue( again );
+repeat
+    process.nsleep( 10000000 );
+    line, err, again = cmd:readline( 'stdout' );
+until not again
+ifNotEqual( line, 'foobar' );
+cmd:wait();
+
+-- other read methods return the buffered data first
+cmd = ifNil( exec( 'printf', { 'hello\nworld\nagain\n' } ) );
+ifNotEqual( cmd:readline( 'stdout' ), 'hello' );
+ifNotEqual( cmd:read( 'stdout', 3 ), 'wor' );
+ifNotEqual( cmd:readall( 'stdout' ), 'ld\nagain\n' );
+cmd:wait();
+
+-- read frames
+cmd = ifNil( exec( 'printf', {
+    '\\000\\000\\000\\005hello\\000\\000\\000\\000\\003\\000abc\\002hi'
+}));
+ifNotEqual( cmd:readframe( 'stdout', 'u32be' ), 'hello' );
+ifNotEqual( cmd:readframe( 'stdout', 'u32be' ), '' );
+ifNotEqual( cmd:readframe( 'stdout', 'u16le' ), 'abc' );
+ifNotEqual( cmd:readframe( 'stdout', 'u8' ), 'hi' );
+ifNotNil( cmd:readframe( 'stdout', 'u8' ) );
+cmd:wait();
+
+-- stream ended in the middle of the frame
+cmd = ifNil( exec( 'printf', { '\\000\\005abc' } ) );
+frame, err = cmd:readframe( 'stdout', 'u16be' );
+ifNotNil( frame );
+ifNil( err );
+cmd:wait();
+
+-- too long
+cmd = ifNil( exec( 'printf', { '\\000\\000\\001\\000' } ) );
+frame, err = cmd:readframe( 'stdout', 'u32be', 255 );
+ifNotNil( frame );
+ifNil( err );
+cmd:wait();
+
+-- too long by default
+cmd = ifNil( exec( 'printf', { '\\001\\000\\000\\001' } ) );
+frame, err = cmd:readframe( 'stdout', 'u32be' );
+ifNotNil( frame );
+ifNil( err );
+cmd:wait();
+
+-- large frame
+cmd = ifNil( exec( 'sh', { '-c', 'printf "\\000\\017\\102\\100"; ' ..
+                           'head -c 1000000 /dev/zero | tr "\\000" x' } ) );
+ifNotEqual( cmd:readframe( 'stdout', 'u32be' ), string.rep( 'x', 1000000 ) );
+cmd:wait();
+
+-- invalid arguments
+ifTrue( pcall( cmd.readline, cmd, 'stdin' ) );
+ifTrue( pcall( cmd.readline, cmd, 'stdout', 0 ) );
+ifTrue( pcall( cmd.readframe, cmd, 'stdout', 'u64be' ) );
+ifTrue( pcall( cmd.readframe, cmd, 'stdout', 'u32be', -1 ) );
+ifTrue( pcall( cmd.readframe, cmd, 'stdout', 'u32be', 0 ) );
@@ -0,0 +1,44 @@
+local process = require('process');
+local exec = process.exec;
+local pids = {};
+local list, tbl, cmd;
+
+-- nothing to reap
+list = ifNil( process.reap() );
+ifNotEqual( list.n, 0 );
+
+for i = 1, 20 do
+    pids[ifNil( exec( 'sh', { '-c', 'exit ' .. i } ) ):pid()] = i;
+end
+process.sleep( 1 );
+
+-- reap with limit
+list = ifNil( process.reap( 5 ) );
+ifNotEqual( list.n, 5 );
+ifNotEqual( #list, 5 );
+for i = 1, list.n do
+    ifNotEqual( list[i].exit, pids[list[i].pid] );
+    pids[list[i].pid] = nil;
+end
+
+-- reuse the entries
+tbl = list[1];
+list = ifNil( process.reap( nil, list ) );
+ifNotEqual( list.n, 15 );
+ifNotEqual( list[1], tbl );
+for i = 1, list.n do
+    ifNotEqual( list[i].exit, pids[list[i].pid] );
+    ifNotNil( list[i].termsig );
+    ifTrue( list[i].utime < 0 );
+    pids[list[i].pid] = nil;
+end
+ifNotNil( next( pids ) );
+
+-- terminated by signal
+cmd = ifNil( exec( 'sleep', { '10' } ) );
+cmd:kill();
+process.sleep( 1 );
+list = ifNil( process.reap( nil, list ) );
+ifNotEqual( list.n, 1 );
+ifNotNil( list[1].exit );
+ifNil( list[1].termsig );
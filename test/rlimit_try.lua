@@ -0,0 +1,73 @@
+local process = require('process');
+local exec = process.exec;
+local NOFILE = process.RLIMIT_NOFILE;
+local soft, hard, ok, err, child, out, osoft, ohard;
+
+-- get
+soft, hard = process.getrlimit( NOFILE );
+ifNil( soft );
+ifNil( hard );
+ifTrue( soft > hard );
+soft, err = process.getrlimit( -1 );
+ifNotNil( soft );
+ifNotEqual( type( err ), 'string' );
+
+-- set soft limit and keep hard limit
+osoft, ohard = process.getrlimit( NOFILE );
+ifNotTrue( process.setrlimit( NOFILE, 64 ) );
+soft, hard = process.getrlimit( NOFILE );
+ifNotEqual( soft, 64 );
+ifNotEqual( hard, ohard );
+ifNotTrue( process.setrlimit( NOFILE, osoft, ohard ) );
+-- soft limit cannot exceed hard limit
+if ohard ~= math.huge then
+    ok, err = process.setrlimit( NOFILE, ohard + 1, ohard );
+    ifNotFalse( ok );
+    ifNil( err );
+end
+ifTrue( pcall( process.setrlimit, NOFILE, -1 ) );
+ifTrue( pcall( process.setrlimit, NOFILE, 'a' ) );
+ifTrue( pcall( process.setrlimit, NOFILE, 1.5 ) );
+ifTrue( pcall( process.setrlimit, NOFILE, 1e20 ) );
+ifTrue( pcall( process.setrlimit, NOFILE, 0/0 ) );
+
+-- running child
+child = ifNil( exec( 'sleep', { '1' } ) );
+soft, hard = process.prlimit( child:pid(), NOFILE );
+ifNotEqual( soft, osoft );
+ifNotEqual( hard, ohard );
+-- returns old limits
+soft, hard = process.prlimit( child:pid(), process.RLIMIT_CPU, 10, 20 );
+ifNil( soft );
+soft, hard = process.prlimit( child:pid(), process.RLIMIT_CPU );
+ifNotEqual( soft, 10 );
+ifNotEqual( hard, 20 );
+-- invalid process
+soft, err = process.prlimit( -1, NOFILE );
+ifNotNil( soft );
+ifNotEqual( type( err ), 'string' );
+child:kill();
+child:wait();
+
+-- rlimits option
+for _, fork in ipairs({ false, true }) do
+    child = ifNil( exec( 'sh', { '-c', 'ulimit -Sn; ulimit -Hn; ulimit -t' },
+                         nil, {
+        fork = fork,
+        rlimits = {
+            [NOFILE] = { 64, 128 },
+            [process.RLIMIT_CPU] = 5
+        }
+    }));
+    out = ifNil( child:readall( 'stdout' ) );
+    ifNotEqual( out, '64\n128\n5\n' );
+    ifNotEqual( ifNil( child:wait() ).exit, 0 );
+end
+-- the calling process is not affected
+soft, hard = process.getrlimit( NOFILE );
+ifNotEqual( soft, osoft );
+-- invalid option
+ifTrue( pcall( exec, 'true', nil, nil, { rlimits = 1 } ) );
+ifTrue( pcall( exec, 'true', nil, nil, { rlimits = { [-1] = 1 } } ) );
+ifTrue( pcall( exec, 'true', nil, nil, { rlimits = { [NOFILE] = 'a' } } ) );
+ifTrue( pcall( exec, 'true', nil, nil, { rlimits = { [NOFILE] = { 1 } } } ) );
@@ -0,0 +1,53 @@
+local process = require('process');
+local exec = process.exec;
+local usage, err, cmd, stat;
+
+-- targets
+usage = ifNil( process.getrusage() );
+ifNil( usage.utime );
+ifNil( process.getrusage( process.RUSAGE_SELF ) );
+ifNil( process.getrusage( process.RUSAGE_CHILDREN ) );
+if process.RUSAGE_THREAD then
+    ifNil( process.getrusage( process.RUSAGE_THREAD ) );
+end
+-- invalid target
+usage, err = process.getrusage( -100 );
+ifNotNil( usage );
+ifNil( err );
+
+-- resource usage of the child
+cmd = ifNil( exec( 'sh', { '-c', 'i=0; while [ $i -lt 10000 ]; do i=$((i+1)); done' } ) );
+stat = ifNil( process.waitpid( cmd:pid(), true ) );
+ifNotEqual( stat.pid, cmd:pid() );
+ifNil( stat.rusage );
+ifTrue( stat.rusage.maxrss <= 0 );
+
+-- without resource usage
+cmd = ifNil( exec( 'true' ) );
+stat = ifNil( process.waitpid( cmd:pid() ) );
+ifNotNil( stat.rusage );
+
+-- child:wait
+cmd = ifNil( exec( 'true' ) );
+stat = ifNil( cmd:wait( -1, true ) );
+ifNil( stat.rusage );
+ifNotEqual( stat.exit, 0 );
+-- cached
+stat = ifNil( cmd:wait( nil, true ) );
+ifNil( stat.rusage );
+ifNotEqual( stat.exit, 0 );
+
+-- fill the table
+local tbl = {};
+ifNotEqual( process.getrusage( process.RUSAGE_SELF, tbl ), tbl );
+ifNotEqual( type( tbl.utime ), 'number' );
+ifTrue( tbl.maxrss <= 0 );
+ifNotEqual( type( tbl.nivcsw ), 'number' );
+
+-- select fields
+local utime, stime, maxrss = process.getrusage( process.RUSAGE_SELF, 'utime', 'stime', 'maxrss' );
+ifTrue( utime < tbl.utime );
+ifTrue( stime < tbl.stime );
+ifTrue( maxrss < tbl.maxrss );
+-- invalid field
+ifTrue( pcall( process.getrusage, process.RUSAGE_SELF, 'unknown' ) );
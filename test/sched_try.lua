@@ -0,0 +1,83 @@
+local process = require('process');
+local exec = process.exec;
+local prio, policy, class, level, ok, err, child, stat, out;
+local mypolicy = ifNil( process.getscheduler() );
+local myclass = ifNil( process.getioprio() );
+
+-- nice value
+prio = ifNil( process.getpriority() );
+ifNotEqual( ifNil( process.getpriority( process.PRIO_PROCESS, 0 ) ), prio );
+child = ifNil( exec( 'sleep', { '1' } ) );
+ifNotTrue( process.setpriority( process.PRIO_PROCESS, child:pid(), 19 ) );
+ifNotEqual( ifNil( process.getpriority( process.PRIO_PROCESS, child:pid() ) ), 19 );
+-- invalid target
+ok, err = process.setpriority( 100000, 0, 0 );
+ifNotFalse( ok );
+ifNil( err );
+
+-- scheduling policy
+ifNotTrue( process.setscheduler( child:pid(), process.SCHED_BATCH ) );
+policy, prio = process.getscheduler( child:pid() );
+ifNotEqual( policy, process.SCHED_BATCH );
+ifNotEqual( prio, 0 );
+-- invalid priority
+ok, err = process.setscheduler( child:pid(), process.SCHED_IDLE, 1 );
+ifNotFalse( ok );
+ifNil( err );
+-- invalid process
+policy, err = process.getscheduler( -1 );
+ifNotNil( policy );
+ifNotEqual( type( err ), 'string' );
+
+-- i/o priority
+ifNotTrue( process.setioprio( process.IOPRIO_WHO_PROCESS, child:pid(),
+                              process.IOPRIO_CLASS_IDLE ) );
+class = process.getioprio( process.IOPRIO_WHO_PROCESS, child:pid() );
+ifNotEqual( class, process.IOPRIO_CLASS_IDLE );
+ifNotTrue( process.setioprio( process.IOPRIO_WHO_PROCESS, child:pid(),
+                              process.IOPRIO_CLASS_BE, 7 ) );
+class, level = process.getioprio( process.IOPRIO_WHO_PROCESS, child:pid() );
+ifNotEqual( class, process.IOPRIO_CLASS_BE );
+ifNotEqual( level, 7 );
+-- invalid process
+class, err = process.getioprio( process.IOPRIO_WHO_PROCESS, -1 );
+ifNotNil( class );
+ifNotEqual( type( err ), 'string' );
+ifTrue( pcall( process.setioprio, 1, 0, 4 ) );
+ifTrue( pcall( process.setioprio, 1, 0, 2, 8 ) );
+child:kill();
+child:wait();
+
+-- exec options
+for _, fork in ipairs({ false, true }) do
+    child = ifNil( exec( 'grep', { '-E', '^(policy|prio)', '/proc/self/sched' },
+                         nil, {
+        fork = fork,
+        sched = process.SCHED_IDLE,
+        nice = 10,
+        ioclass = process.IOPRIO_CLASS_IDLE
+    }));
+    out = ifNil( child:readall( 'stdout' ) );
+    ifNil( out:find( 'policy%s+:%s+' .. process.SCHED_IDLE ) );
+    -- static priority 120 + nice value
+    ifNil( out:find( 'prio%s+:%s+130' ) );
+    stat = ifNil( child:wait() );
+    ifNotEqual( stat.exit, 0 );
+end
+-- the calling process is not affected
+ifNotEqual( process.getscheduler(), mypolicy );
+ifNotEqual( process.getioprio(), myclass );
+-- a failure to apply is reported as the spawn error
+child, err = exec( 'true', nil, nil, {
+    sched = process.SCHED_FIFO,
+    schedprio = 1000
+});
+ifNotNil( child );
+ifNil( err );
+-- invalid option
+ifTrue( pcall( exec, 'true', nil, nil, { nice = 'a' } ) );
+ifTrue( pcall( exec, 'true', nil, nil, { ioclass = 4 } ) );
+ifTrue( pcall( exec, 'true', nil, nil, {
+    ioclass = process.IOPRIO_CLASS_BE,
+    iolevel = 8
+}));
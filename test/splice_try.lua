@@ -0,0 +1,43 @@
+local process = require('process');
+local exec = process.exec;
+local waitpid = process.waitpid;
+local src, dest, fdin, len, err, again;
+
+if not ifNil( exec( 'true' ) ).splice_stdout then
+    return;
+end
+
+-- child stdout -> other child stdin
+src = ifNil( exec( 'echo', { 'hello world' } ) );
+dest = ifNil( exec( 'cat' ) );
+fdin = dest:fds();
+len = ifNil( src:splice_stdout( fdin ) );
+ifNotEqual( len, 12 );
+-- end-of-file
+ifNotEqual( src:splice_stdout( fdin ), 0 );
+ifNotEqual( dest:stdout(), 'hello world\n' );
+waitpid( src:pid() );
+
+-- other child stdout -> child stdin with length
+src = ifNil( exec( 'echo', { 'hello world' } ) );
+len = ifNil( dest:splice_stdin( select( 2, src:fds() ), 5 ) );
+ifNotEqual( len, 5 );
+ifNotEqual( dest:stdout(), 'hello' );
+waitpid( src:pid() );
+dest:kill();
+waitpid( dest:pid() );
+
+-- non-blocking
+src = ifNil( exec( 'sleep', { '1' }, nil, { nonblock = true } ) );
+dest = ifNil( exec( 'cat' ) );
+fdin = dest:fds();
+len, err, again = src:splice_stdout( fdin );
+ifNotNil( len );
+ifNil( err );
+ifNotTrue( again );
+waitpid( src:pid() );
+dest:kill();
+waitpid( dest:pid() );
+
+-- invalid length
+ifTrue( pcall( src.splice_stdout, src, fdin, 0 ) );
@@ -0,0 +1,50 @@
+local process = require('process');
+local exec = process.exec;
+local stats, tbl, child, live;
+
+process.resetstats();
+stats = ifNil( process.stats() );
+ifNotEqual( stats.spawn, 0 );
+ifNotEqual( stats.reaped, 0 );
+live = stats.live;
+
+-- spawn and pipe
+child = ifNil( exec( 'cat' ) );
+ifNotEqual( child:stdin( 'hello' ), 5 );
+ifNotEqual( child:read( 'stdout', 5 ), 'hello' );
+child:kill();
+ifNil( child:wait() );
+-- spawn failure
+ifNotNil( exec( './unknown-command' ) );
+
+stats = process.stats();
+ifNotEqual( stats.spawn, 2 );
+ifNotEqual( stats.spawnfail, 1 );
+ifNotEqual( stats.errors[process.ENOENT], 1 );
+ifNotEqual( stats.written, 5 );
+ifNotEqual( stats.read, 5 );
+ifNotEqual( stats.reaped, 1 );
+ifNotEqual( stats.live, live + 1 );
+
+-- EAGAIN
+child = ifNil( exec( 'sleep', { '1' }, nil, { nonblock = true } ) );
+ifNotTrue( select( 3, child:read( 'stdout' ) ) );
+ifNotEqual( process.stats().eagain, 1 );
+child:kill();
+child:wait();
+
+-- live instances
+child = nil;
+collectgarbage('collect');
+collectgarbage('collect');
+ifNotEqual( process.stats().live, live );
+
+-- fill the table
+tbl = {};
+ifNotEqual( process.stats( tbl ), tbl );
+ifNotEqual( tbl.errors[process.ENOENT], 1 );
+process.resetstats();
+process.stats( tbl );
+ifNotEqual( tbl.spawn, 0 );
+ifNotNil( tbl.errors[process.ENOENT] );
+ifNotEqual( tbl.live, live );
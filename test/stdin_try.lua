@@ -0,0 +1,34 @@
+local process = require('process');
+local exec = process.exec;
+local waitpid = process.waitpid;
+local cmd, payload;
+
+-- multiple data
+cmd = ifNil( exec( 'cat' ) );
+ifNotEqual( cmd:stdin( 'hello', ' ', 'world' ), 11 );
+ifNotEqual( cmd:read( 'stdout', 11 ), 'hello world' );
+
+-- array of data
+ifNotEqual( cmd:stdin({ 'hello', ' ', 'world' }), 11 );
+ifNotEqual( cmd:read( 'stdout', 11 ), 'hello world' );
+
+-- empty array
+ifNotEqual( cmd:stdin({}), 0 );
+
+-- invalid data
+ifTrue( pcall( cmd.stdin, cmd ) );
+ifTrue( pcall( cmd.stdin, cmd, { 'hello', {} } ) );
+
+-- vmsplice
+if cmd.vmsplice then
+    payload = string.rep( 'x', 1024 * 32 );
+    ifNotEqual( cmd:vmsplice( payload, payload ), #payload * 2 );
+    local data = '';
+    while #data < #payload * 2 do
+        data = data .. ifNil( cmd:read( 'stdout', #payload * 2 - #data ) );
+    end
+    ifNotEqual( data, payload .. payload );
+end
+
+cmd:kill();
+waitpid( cmd:pid() );
@@ -0,0 +1,40 @@
+local process = require('process');
+local exec = process.exec;
+local child, t, tbl, before;
+
+-- vfork mode
+before = process.clock();
+child = ifNil( exec( 'sh', { '-c', 'sleep 0.1; echo hello' } ) );
+t = ifNil( child:timings() );
+ifTrue( t.start < before );
+ifTrue( t.fork < t.start );
+ifTrue( t.setup < t.fork );
+ifTrue( t.exec < t.setup );
+ifTrue( t.spawned < t.exec );
+ifNotNil( t.firstbyte );
+ifNotNil( t.exit );
+
+ifNotEqual( child:read( 'stdout' ), 'hello\n' );
+ifNil( child:wait() );
+t = child:timings();
+ifTrue( t.firstbyte - t.spawned < 100000000 );
+ifTrue( t.exit < t.firstbyte );
+
+-- fork mode does not record the phases of the child
+child = ifNil( exec( 'true', nil, nil, { fork = true } ) );
+child:wait();
+tbl = {};
+t = child:timings( tbl );
+ifNotEqual( t, tbl );
+ifNil( t.fork );
+ifNotNil( t.setup );
+ifNotNil( t.exec );
+ifTrue( t.spawned < t.fork );
+ifTrue( t.exit < t.spawned );
+
+-- command
+child = ifNil( ifNil( process.command( 'true' ) ):spawn() );
+t = child:timings();
+ifNil( t.start );
+ifNil( t.exec );
+child:wait();
@@ -0,0 +1,33 @@
+local signal = require('signal');
+local process = require('process');
+local exec = process.exec;
+local cmd, stat, err, pidfd;
+
+-- wait for exit
+cmd = ifNil( exec( 'sh', { '-c', 'exit 3' } ) );
+stat = ifNil( cmd:wait() );
+ifNotEqual( stat.pid, cmd:pid() );
+ifNotEqual( stat.exit, 3 );
+-- cached status
+stat = ifNil( cmd:wait() );
+ifNotEqual( stat.exit, 3 );
+-- cannot signal to the collected process
+ifNil( cmd:kill() );
+
+-- timed out
+cmd = ifNil( exec( 'sleep', { '1' } ) );
+stat, err = cmd:wait( 10 );
+ifNotNil( stat );
+ifNotNil( err );
+ifNotNil( cmd:kill( signal.SIGKILL ) );
+stat = ifNil( cmd:wait( 1000 ) );
+ifNotEqual( stat.termsig, signal.SIGKILL );
+
+-- process descriptor
+cmd = ifNil( exec( 'sh', { '-c', 'exit 0' } ) );
+pidfd = cmd:pidfd();
+if pidfd then
+    ifTrue( pidfd < 3 );
+end
+stat = ifNil( cmd:wait( 1000 ) );
+ifNotEqual( stat.exit, 0 );
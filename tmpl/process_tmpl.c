@@ -31,7 +31,15 @@
 extern char **environ;
 
 // MARK: environment
-static int getenv_lua( lua_State *L )
+// generation of the environment that is incremented by setenv and unsetenv
+static unsigned int ENV_GEN = 0;
+
+// registry keys of the cached environment snapshot
+static const char ENV_SNAPSHOT = 0;
+static const char ENV_SNAPSHOT_GEN = 0;
+
+
+static void pushenviron( lua_State *L )
 {
     char **ptr = environ;
     char *val = NULL;
@@ -46,8 +54,103 @@ static int getenv_lua( lua_State *L )
         }
         ptr++;
     }
+}
 
-    return 1;
+
+static void pushsnapshot( lua_State *L )
+{
+    lua_pushlightuserdata( L, (void*)&ENV_SNAPSHOT_GEN );
+    lua_rawget( L, LUA_REGISTRYINDEX );
+    // use the cached snapshot
+    if( lua_type( L, -1 ) == LUA_TNUMBER &&
+        (unsigned int)lua_tointeger( L, -1 ) == ENV_GEN ){
+        lua_pop( L, 1 );
+        lua_pushlightuserdata( L, (void*)&ENV_SNAPSHOT );
+        lua_rawget( L, LUA_REGISTRYINDEX );
+        return;
+    }
+    lua_pop( L, 1 );
+
+    // create new snapshot
+    pushenviron( L );
+    lua_pushlightuserdata( L, (void*)&ENV_SNAPSHOT );
+    lua_pushvalue( L, -2 );
+    lua_rawset( L, LUA_REGISTRYINDEX );
+    lua_pushlightuserdata( L, (void*)&ENV_SNAPSHOT_GEN );
+    lua_pushinteger( L, ENV_GEN );
+    lua_rawset( L, LUA_REGISTRYINDEX );
+}
+
+
+static int getenv_lua( lua_State *L )
+{
+    const char *val = NULL;
+
+    switch( lua_type( L, 1 ) ){
+        // all environment variables
+        case LUA_TNONE:
+        case LUA_TNIL:
+            pushenviron( L );
+            return 1;
+
+        // cached snapshot
+        case LUA_TBOOLEAN:
+            if( lua_toboolean( L, 1 ) ){
+                pushsnapshot( L );
+            }
+            else {
+                pushenviron( L );
+            }
+            return 1;
+
+        // single variable
+        default:
+            if( ( val = getenv( luaL_checkstring( L, 1 ) ) ) ){
+                lua_pushstring( L, val );
+            }
+            else {
+                lua_pushnil( L );
+            }
+            return 1;
+    }
+}
+
+
+static int setenv_lua( lua_State *L )
+{
+    const char *name = luaL_checkstring( L, 1 );
+    const char *val = luaL_checkstring( L, 2 );
+    int overwrite = lauxh_optboolean( L, 3, 1 );
+
+    if( setenv( name, val, overwrite ) == 0 ){
+        ENV_GEN++;
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int unsetenv_lua( lua_State *L )
+{
+    const char *name = luaL_checkstring( L, 1 );
+
+    if( unsetenv( name ) == 0 ){
+        ENV_GEN++;
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
 }
 
 
@@ -310,40 +413,183 @@ static int setsid_lua( lua_State *L )
 
 
 // MARK: resource
+static const char *const RUSAGE_FIELDS[] = {
+    "utime", "stime", "maxrss", "ixrss", "idrss", "isrss", "minflt",
+    "majflt", "nswap", "inblock", "oublock", "msgsnd", "msgrcv",
+    "nsignals", "nvcsw", "nivcsw", NULL
+};
+
+
+static inline lua_Integer rusage_field( struct rusage *usage, int field )
+{
+    switch( field ){
+        case 0:
+            return (lua_Integer)usage->ru_utime.tv_sec * 1000000 +
+                   usage->ru_utime.tv_usec;
+        case 1:
+            return (lua_Integer)usage->ru_stime.tv_sec * 1000000 +
+                   usage->ru_stime.tv_usec;
+        case 2:
+            return usage->ru_maxrss;
+        case 3:
+            return usage->ru_ixrss;
+        case 4:
+            return usage->ru_idrss;
+        case 5:
+            return usage->ru_isrss;
+        case 6:
+            return usage->ru_minflt;
+        case 7:
+            return usage->ru_majflt;
+        case 8:
+            return usage->ru_nswap;
+        case 9:
+            return usage->ru_inblock;
+        case 10:
+            return usage->ru_oublock;
+        case 11:
+            return usage->ru_msgsnd;
+        case 12:
+            return usage->ru_msgrcv;
+        case 13:
+            return usage->ru_nsignals;
+        case 14:
+            return usage->ru_nvcsw;
+        default:
+            return usage->ru_nivcsw;
+    }
+}
+
+
 static int getrusage_lua( lua_State *L )
 {
+    const int argc = lua_gettop( L );
+    int who = (int)luaL_optinteger( L, 1, RUSAGE_SELF );
     struct rusage usage;
+    int i = 0;
 
-    if( getrusage( RUSAGE_SELF, &usage ) == 0 ){
-        lua_newtable( L );
-        lauxh_pushnum2tbl( L, "maxrss", usage.ru_maxrss );
-        lauxh_pushnum2tbl( L, "ixrss", usage.ru_ixrss );
-        lauxh_pushnum2tbl( L, "idrss", usage.ru_idrss );
-        lauxh_pushnum2tbl( L, "isrss", usage.ru_isrss );
-        lauxh_pushnum2tbl( L, "minflt", usage.ru_minflt );
-        lauxh_pushnum2tbl( L, "majflt", usage.ru_majflt );
-        lauxh_pushnum2tbl( L, "nswap", usage.ru_nswap );
-        lauxh_pushnum2tbl( L, "inblock", usage.ru_inblock );
-        lauxh_pushnum2tbl( L, "oublock", usage.ru_oublock );
-        lauxh_pushnum2tbl( L, "msgsnd", usage.ru_msgsnd );
-        lauxh_pushnum2tbl( L, "msgrcv", usage.ru_msgrcv );
-        lauxh_pushnum2tbl( L, "nsignals", usage.ru_nsignals );
-        lauxh_pushnum2tbl( L, "nvcsw", usage.ru_nvcsw );
-        lauxh_pushnum2tbl( L, "nivcsw", usage.ru_nivcsw );
-        lua_pushstring( L, "utime" );
-        lua_newtable( L );
-        lauxh_pushnum2tbl( L, "sec", usage.ru_utime.tv_sec );
-        lauxh_pushnum2tbl( L, "usec", usage.ru_utime.tv_usec );
-        lua_rawset( L, -3 );
-        lua_pushstring( L, "stime" );
-        lua_newtable( L );
-        lauxh_pushnum2tbl( L, "sec", usage.ru_stime.tv_sec );
-        lauxh_pushnum2tbl( L, "usec", usage.ru_stime.tv_usec );
-        lua_rawset( L, -3 );
+    if( getrusage( who, &usage ) != 0 ){
+        lua_pushnil( L );
+        lua_pushstring( L, strerror( errno ) );
+        return 2;
+    }
+    else if( argc < 2 ){
+        pushrusage( L, &usage );
+        return 1;
+    }
+    // fill the passed table; times are in microseconds
+    else if( lua_type( L, 2 ) == LUA_TTABLE )
+    {
+        lua_settop( L, 2 );
+        for(; RUSAGE_FIELDS[i]; i++ ){
+            lua_pushstring( L, RUSAGE_FIELDS[i] );
+            lua_pushinteger( L, rusage_field( &usage, i ) );
+            lua_rawset( L, 2 );
+        }
+        return 1;
+    }
+
+    // return the specified fields
+    luaL_checkstack( L, argc, NULL );
+    for( i = 2; i <= argc; i++ ){
+        lua_pushinteger( L, rusage_field( &usage,
+                                         luaL_checkoption( L, i, NULL,
+                                                           RUSAGE_FIELDS ) ) );
+    }
+
+    return argc - 1;
+}
+
+
+static int getrlimit_lua( lua_State *L )
+{
+    int res = (int)luaL_checkinteger( L, 1 );
+    struct rlimit rlim;
 
+    if( getrlimit( res, &rlim ) == 0 ){
+        pushrlim( L, rlim.rlim_cur );
+        pushrlim( L, rlim.rlim_max );
+        return 2;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int setrlimit_lua( lua_State *L )
+{
+    int res = (int)luaL_checkinteger( L, 1 );
+    struct rlimit rlim = {
+        .rlim_cur = checkrlim( L, 2, 2 )
+    };
+
+    // keep the current hard limit
+    if( lua_isnoneornil( L, 3 ) ){
+        struct rlimit cur;
+
+        if( getrlimit( res, &cur ) == -1 ){
+            goto FAILURE;
+        }
+        rlim.rlim_max = cur.rlim_max;
+    }
+    else {
+        rlim.rlim_max = checkrlim( L, 3, 3 );
+    }
+
+    if( setrlimit( res, &rlim ) == 0 ){
+        lua_pushboolean( L, 1 );
         return 1;
     }
 
+FAILURE:
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int prlimit_lua( lua_State *L )
+{
+    pid_t pid = (pid_t)luaL_checkinteger( L, 1 );
+    int res = (int)luaL_checkinteger( L, 2 );
+#if defined(__linux__)
+    struct rlimit old;
+    struct rlimit rlim;
+    struct rlimit *lim = NULL;
+
+    if( !lua_isnoneornil( L, 3 ) )
+    {
+        rlim.rlim_cur = checkrlim( L, 3, 3 );
+        if( !lua_isnoneornil( L, 4 ) ){
+            rlim.rlim_max = checkrlim( L, 4, 4 );
+            lim = &rlim;
+        }
+        // keep the current hard limit
+        else if( prlimit( pid, res, NULL, &old ) == 0 ){
+            rlim.rlim_max = old.rlim_max;
+            lim = &rlim;
+        }
+    }
+
+    // return the old limits
+    if( ( lim || lua_isnoneornil( L, 3 ) ) &&
+        prlimit( pid, res, lim, &old ) == 0 ){
+        pushrlim( L, old.rlim_cur );
+        pushrlim( L, old.rlim_max );
+        return 2;
+    }
+#else
+    (void)pid;
+    (void)res;
+    errno = ENOTSUP;
+#endif
+
     // got error
     lua_pushnil( L );
     lua_pushstring( L, strerror( errno ) );
@@ -391,63 +637,363 @@ static int fork_lua( lua_State *L )
 {
     pid_t pid = fork();
 
+    PSTATS.fork++;
     if( pid != -1 ){
         lua_pushinteger( L, pid );
         return 1;
     }
 
     // got error
+    PSTATS.forkfail++;
+    pstats_error( errno );
     lua_pushnil( L );
     lua_pushstring( L, strerror( errno ) );
-    lua_pushboolean( L, errno == EAGAIN );
+    lua_pushboolean( L, pstats_again( errno ) );
 
     return 3;
 }
 
 
+// MARK: cpu affinity
+static int getaffinity_lua( lua_State *L )
+{
+    pid_t pid = (pid_t)luaL_optinteger( L, 1, 0 );
+#if defined(__linux__)
+    cpu_set_t set;
+
+    if( sched_getaffinity( pid, sizeof( cpu_set_t ), &set ) == 0 )
+    {
+        int n = 0;
+        int cpu = 0;
+
+        lua_createtable( L, CPU_COUNT( &set ), 0 );
+        for(; cpu < CPU_SETSIZE; cpu++ )
+        {
+            if( CPU_ISSET( cpu, &set ) ){
+                lua_pushinteger( L, cpu );
+                lua_rawseti( L, -2, ++n );
+            }
+        }
+        return 1;
+    }
+#else
+    (void)pid;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int setaffinity_lua( lua_State *L )
+{
+    pid_t pid = (pid_t)luaL_optinteger( L, 1, 0 );
+#if defined(__linux__)
+    cpu_set_t set;
+
+    checkcpuset( L, 2, &set, 2 );
+    if( sched_setaffinity( pid, sizeof( cpu_set_t ), &set ) == 0 ){
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+#else
+    (void)pid;
+    luaL_checktype( L, 2, LUA_TTABLE );
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+// MARK: scheduling
+static int getpriority_lua( lua_State *L )
+{
+    int which = (int)luaL_optinteger( L, 1, PRIO_PROCESS );
+    id_t who = (id_t)luaL_optinteger( L, 2, 0 );
+    int prio = 0;
+
+    // NOTE: -1 is a legitimate return value
+    errno = 0;
+    prio = getpriority( which, who );
+    if( prio != -1 || errno == 0 ){
+        lua_pushinteger( L, prio );
+        return 1;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int setpriority_lua( lua_State *L )
+{
+    int which = (int)luaL_checkinteger( L, 1 );
+    id_t who = (id_t)luaL_checkinteger( L, 2 );
+    int prio = (int)luaL_checkinteger( L, 3 );
+
+    if( setpriority( which, who, prio ) == 0 ){
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int getscheduler_lua( lua_State *L )
+{
+    pid_t pid = (pid_t)luaL_optinteger( L, 1, 0 );
+#if defined(__linux__)
+    struct sched_param param;
+    int policy = sched_getscheduler( pid );
+
+    if( policy != -1 && sched_getparam( pid, &param ) == 0 ){
+        lua_pushinteger( L, policy );
+        lua_pushinteger( L, param.sched_priority );
+        return 2;
+    }
+#else
+    (void)pid;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int setscheduler_lua( lua_State *L )
+{
+    pid_t pid = (pid_t)luaL_checkinteger( L, 1 );
+    int policy = (int)luaL_checkinteger( L, 2 );
+#if defined(__linux__)
+    struct sched_param param = {
+        .sched_priority = (int)luaL_optinteger( L, 3, 0 )
+    };
+
+    if( sched_setscheduler( pid, policy, &param ) == 0 ){
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+#else
+    (void)pid;
+    (void)policy;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int getioprio_lua( lua_State *L )
+{
+#if defined(__linux__)
+    int which = (int)luaL_optinteger( L, 1, IOPRIO_WHO_PROCESS );
+    int who = (int)luaL_optinteger( L, 2, 0 );
+    int ioprio = ioprio_get_r( which, who );
+
+    if( ioprio != -1 ){
+        lua_pushinteger( L, PIOPRIO_CLASS( ioprio ) );
+        lua_pushinteger( L, PIOPRIO_DATA( ioprio ) );
+        return 2;
+    }
+#else
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+static int setioprio_lua( lua_State *L )
+{
+    int which = (int)luaL_checkinteger( L, 1 );
+    int who = (int)luaL_checkinteger( L, 2 );
+    int cls = (int)luaL_checkinteger( L, 3 );
+    int data = (int)luaL_optinteger( L, 4, 0 );
+
+    luaL_argcheck( L, cls >= 0 && cls <= 3, 3,
+                   "class must be IOPRIO_CLASS_* constant" );
+    luaL_argcheck( L, data >= 0 && data <= 7, 4, "data must be in range 0-7" );
+#if defined(__linux__)
+    if( ioprio_set_r( which, who, PIOPRIO_VALUE( cls, data ) ) == 0 ){
+        lua_pushboolean( L, 1 );
+        return 1;
+    }
+#else
+    (void)which;
+    (void)who;
+    errno = ENOTSUP;
+#endif
+
+    // got error
+    lua_pushboolean( L, 0 );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
+// MARK: reap
+static inline void pushtimeval2tbl( lua_State *L, const char *k,
+                                    struct timeval *tv )
+{
+    lua_pushstring( L, k );
+    lua_pushinteger( L, (lua_Integer)tv->tv_sec * 1000000 + tv->tv_usec );
+    lua_rawset( L, -3 );
+}
+
+
+static inline void pushnil2tbl( lua_State *L, const char *k )
+{
+    lua_pushstring( L, k );
+    lua_pushnil( L );
+    lua_rawset( L, -3 );
+}
+
+
+static int reap_lua( lua_State *L )
+{
+    lua_Integer max = luaL_optinteger( L, 1, 0 );
+    lua_Integer n = 0;
+    struct rusage usage;
+    pid_t pid = 0;
+    int rc = 0;
+
+    // use the passed table
+    if( lua_gettop( L ) > 1 ){
+        luaL_checktype( L, 2, LUA_TTABLE );
+        lua_settop( L, 2 );
+    }
+    else {
+        lua_settop( L, 1 );
+        lua_newtable( L );
+    }
+
+    // reap all exited children unless max is specified
+    while( max <= 0 || n < max )
+    {
+        pid = wait4( -1, &rc, WNOHANG, &usage );
+        if( pid == 0 ){
+            break;
+        }
+        else if( pid == -1 )
+        {
+            if( errno == EINTR ){
+                continue;
+            }
+            // got error
+            else if( errno != ECHILD && n == 0 ){
+                lua_pushnil( L );
+                lua_pushstring( L, strerror( errno ) );
+                return 2;
+            }
+            break;
+        }
+
+        // reuse the existing entry
+        PSTATS.reaped++;
+        n++;
+        lua_rawgeti( L, 2, n );
+        if( !lua_istable( L, -1 ) ){
+            lua_pop( L, 1 );
+            lua_createtable( L, 0, 6 );
+            lua_pushvalue( L, -1 );
+            lua_rawseti( L, 2, n );
+        }
+        lauxh_pushnum2tbl( L, "pid", pid );
+        if( WIFEXITED( rc ) ){
+            lauxh_pushnum2tbl( L, "exit", WEXITSTATUS( rc ) );
+            pushnil2tbl( L, "termsig" );
+        }
+        else {
+            pushnil2tbl( L, "exit" );
+            lauxh_pushnum2tbl( L, "termsig", WTERMSIG( rc ) );
+        }
+        pushtimeval2tbl( L, "utime", &usage.ru_utime );
+        pushtimeval2tbl( L, "stime", &usage.ru_stime );
+        lauxh_pushnum2tbl( L, "maxrss", usage.ru_maxrss );
+        lua_pop( L, 1 );
+    }
+
+    // number of entries; the entries after n are left for reuse
+    lua_pushstring( L, "n" );
+    lua_pushinteger( L, n );
+    lua_rawset( L, 2 );
+
+    return 1;
+}
+
+
 static int waitpid_lua( lua_State *L )
 {
     const int argc = lua_gettop( L );
     pid_t pid = luaL_optinteger( L, 1, -1 );
+    struct rusage usage;
     pid_t rpid = 0;
     int rc = 0;
     int opts = 0;
+    int rusage = 0;
 
     // check opts
     if( argc > 1 )
     {
         int i = 2;
 
-        for(; i <= argc; i++ ){
-            opts |= (int)luaL_optinteger( L, i, 0 );
+        for(; i <= argc; i++ )
+        {
+            // get the resource usage of the child
+            if( lua_type( L, i ) == LUA_TBOOLEAN ){
+                rusage = lua_toboolean( L, i );
+            }
+            else {
+                opts |= (int)luaL_optinteger( L, i, 0 );
+            }
         }
     }
 
-    rpid = waitpid( pid, &rc, opts );
+    rpid = wait4( pid, &rc, opts, &usage );
     // WNOHANG
     if( rpid == 0 ){
         lua_pushnil( L );
         return 1;
     }
-    else if( rpid != -1 )
-    {
-        lua_createtable( L, 0, 2 );
-        lauxh_pushnum2tbl( L, "pid", rpid );
-        // exit status
-        if( WIFEXITED( rc ) ){
-            lauxh_pushnum2tbl( L, "exit", WEXITSTATUS( rc ) );
-        }
-        // exit signal number
-        else if( WIFSIGNALED( rc ) ){
-            lauxh_pushnum2tbl( L, "termsig", WTERMSIG( rc ) );
-        }
-        // stop signal
-        else if( WIFSTOPPED( rc ) ){
-            lauxh_pushnum2tbl( L, "stopsig", WSTOPSIG( rc ) );
+    else if( rpid != -1 ){
+        if( WIFEXITED( rc ) || WIFSIGNALED( rc ) ){
+            PSTATS.reaped++;
         }
-        // continue signal
-        else if( WIFCONTINUED( rc ) ){
-            lauxh_pushbool2tbl( L, "continue", 1 );
+        pushwaitstatus( L, rpid, rc );
+        if( rusage ){
+            lua_pushstring( L, "rusage" );
+            pushrusage( L, &usage );
+            lua_rawset( L, -3 );
         }
         return 1;
     }
@@ -470,42 +1016,69 @@ static int waitpid_lua( lua_State *L )
 static int exec_lua( lua_State *L )
 {
     int argc = lua_gettop( L );
-    const char *cmd = luaL_checkstring( L, 1 );
-    const char *pwd = NULL;
+    ptimings_t t = { .start = getnsec() };
+    pspawn_t ps = {
+        .path = luaL_checkstring( L, 1 ),
+        .argv = NULL,
+        .envp = NULL,
+        .pwd = NULL,
+        .iop = NULL,
+        .usefork = 0,
+        .timings = &t,
+        .attr = NULL,
+        .cgroup = NULL
+    };
+    pattr_t attr;
+    pstdio_t stdio[3] = { pstdio_pipe, pstdio_pipe, pstdio_pipe };
+    int nonblock = 0;
+    int pipesize = 0;
     pid_t pid = 0;
     array_t argv = arr_no_value;
     array_t envs = arr_no_value;
     iopipe_t iop = iop_no_value;
 
+    // manipute arg length
+    if( argc > 5 ){
+        argc = 5;
+    }
+
+    // check options
+    if( argc > 3 )
+    {
+        // options table
+        if( lua_type( L, 4 ) == LUA_TTABLE ){
+            ps.pwd = opt_string( L, 4, "cwd", NULL );
+            ps.cgroup = opt_string( L, 4, "cgroup", NULL );
+            nonblock = opt_boolean( L, 4, "nonblock", 0 );
+            pipesize = iop_checkpipesize( L, 4 );
+            ps.usefork = opt_boolean( L, 4, "fork", 0 );
+            iop_checkstdio( L, 4, stdio );
+            pattr_check( L, 4, &attr );
+            ps.attr = &attr;
+        }
+        // cwd and nonblock
+        else {
+            ps.pwd = lauxh_optstring( L, 4, NULL );
+            nonblock = lauxh_optboolean( L, 5, 0 );
+        }
+        argc = 3;
+    }
+
     // init arg containers
     if( arr_init( &argv, ARG_MAX ) == -1 ||
-        arr_push( &argv, (char*)cmd ) == -1 ||
+        arr_push( &argv, (char*)ps.path ) == -1 ||
         arr_init( &envs, 0 ) == -1 ||
-        iop_init( &iop ) == -1 ){
+        iop_init( &iop, stdio ) == -1 ||
+        ( nonblock && iop_setnonblock( &iop ) == -1 ) ||
+        ( pipesize && iop_setpipesize( &iop, pipesize ) == -1 ) ){
         lua_pushnil( L );
         lua_pushstring( L, strerror( errno ) );
         goto CLEANUP;
     }
-    // manipute arg length
-    else if( argc > 5 ){
-        argc = 5;
-    }
 
     // check args
     switch( argc )
     {
-        // nonblock
-        case 5:
-            if( lauxh_optboolean( L, 5, 0 ) && iop_setnonblock( &iop ) == -1 ){
-                lua_pushnil( L );
-                lua_pushstring( L, strerror( errno ) );
-                goto CLEANUP;
-            }
-
-        // cwd
-        case 4:
-            pwd = lauxh_optstring( L, 4, NULL );
-
         // envs
         case 3:
             if( !lua_isnoneornil( L, 3 ) &&
@@ -553,32 +1126,14 @@ static int exec_lua( lua_State *L )
             }
     }
 
-    pid = fork();
-    // child
-    if( pid == 0 )
-    {
-        // set process-working-directory and
-        if( pwd != NULL && chdir( pwd ) == -1 ){
-            perror( "failed to chdir()" );
-        }
-        // set std-in-out-err
-        else if( iop_set( &iop ) != 0 ){
-            perror( "failed to iop_set()" );
-        }
-        else
-        {
-            if( envs.len ){
-                environ = envs.elts;
-            }
-            execvp( cmd, argv.elts );
-            perror( "failed to execvp()" );
-        }
-        arr_dispose( &argv );
-        arr_dispose( &envs );
-        _exit(0);
+    ps.argv = argv.elts;
+    if( envs.len ){
+        ps.envp = envs.elts;
     }
+    ps.iop = &iop;
+
     // got error
-    else if( pid == -1 ){
+    if( ( pid = pspawn( &ps ) ) == -1 ){
         lua_pushnil( L );
         lua_pushstring( L, strerror( errno ) );
         goto CLEANUP;
@@ -591,7 +1146,7 @@ static int exec_lua( lua_State *L )
     // close read-stdin, write-stdout
     iop_unset( &iop );
     if( newpchild( L, pid, iop.fds[IOP_IN_WRITE], iop.fds[IOP_OUT_READ],
-                   iop.fds[IOP_ERR_READ] ) != 0 )
+                   iop.fds[IOP_ERR_READ], nonblock, &t ) != 0 )
     {
         int err = errno;
 
@@ -646,6 +1201,59 @@ static int nsleep_lua( lua_State *L )
 }
 
 
+static int clocksleep_lua( lua_State *L )
+{
+    lua_Integer nsec = luaL_checkinteger( L, 1 );
+    clockid_t id = (clockid_t)luaL_optinteger( L, 2, CLOCK_MONOTONIC );
+    int flags = (int)luaL_optinteger( L, 3, 0 );
+    struct timespec req = {
+        .tv_sec = nsec / INT64_C(1000000000),
+        .tv_nsec = nsec % INT64_C(1000000000)
+    };
+    struct timespec rem = { 0, 0 };
+    int rc = 0;
+
+    luaL_argcheck( L, nsec >= 0, 1, "nsec must be greater than or equal to 0" );
+#if defined(TIMER_ABSTIME)
+    rc = clock_nanosleep( id, flags, &req, &rem );
+#else
+    // clock_nanosleep is not supported; relative sleep only
+    if( flags ){
+        rc = ENOTSUP;
+    }
+    else if( nanosleep( &req, &rem ) != 0 ){
+        rc = errno;
+    }
+    (void)id;
+#endif
+
+    if( rc == 0 ){
+        lua_pushinteger( L, 0 );
+        return 1;
+    }
+    // interrupted by signal
+    else if( rc == EINTR )
+    {
+        // the deadline can be passed again as it is
+        if( flags ){
+            lua_pushinteger( L, nsec );
+        }
+        else {
+            lua_pushinteger( L, (lua_Integer)rem.tv_sec * 1000000000 +
+                                rem.tv_nsec );
+        }
+        lua_pushstring( L, strerror( rc ) );
+        return 2;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( rc ) );
+
+    return 2;
+}
+
+
 // MARK: errors
 static int errno_lua( lua_State *L )
 {
@@ -688,6 +1296,24 @@ static int gettimeofday_lua( lua_State *L )
 }
 
 
+static int clock_lua( lua_State *L )
+{
+    clockid_t id = (clockid_t)luaL_optinteger( L, 1, CLOCK_MONOTONIC );
+    struct timespec ts;
+
+    if( clock_gettime( id, &ts ) == 0 ){
+        lua_pushinteger( L, (lua_Integer)ts.tv_sec * 1000000000 + ts.tv_nsec );
+        return 1;
+    }
+
+    // got error
+    lua_pushnil( L );
+    lua_pushstring( L, strerror( errno ) );
+
+    return 2;
+}
+
+
 
 // MARK: descriptor
 static int dup_lua( lua_State *L )
@@ -748,6 +1374,8 @@ LUALIB_API int luaopen_process( lua_State *L )
     struct luaL_Reg method[] = {
         // environment
         { "getenv", getenv_lua },
+        { "setenv", setenv_lua },
+        { "unsetenv", unsetenv_lua },
         // process id
         { "getpid", getpid_lua },
         { "getppid", getppid_lua },
@@ -770,21 +1398,46 @@ LUALIB_API int luaopen_process( lua_State *L )
         { "setsid", setsid_lua },
         // resources
         { "getrusage", getrusage_lua },
+        { "getrlimit", getrlimit_lua },
+        { "setrlimit", setrlimit_lua },
+        { "prlimit", prlimit_lua },
         // current working directory
         { "getcwd", getcwd_lua },
         { "chdir", chdir_lua },
         // child process
         { "fork", fork_lua },
         { "waitpid", waitpid_lua },
+        { "reap", reap_lua },
         { "exec", exec_lua },
+        { "execcache", execcache_lua },
+        { "flushexeccache", flushexeccache_lua },
+        // cpu affinity
+        { "getaffinity", getaffinity_lua },
+        { "setaffinity", setaffinity_lua },
+        // scheduling
+        { "getpriority", getpriority_lua },
+        { "setpriority", setpriority_lua },
+        { "getscheduler", getscheduler_lua },
+        { "setscheduler", setscheduler_lua },
+        { "getioprio", getioprio_lua },
+        { "setioprio", setioprio_lua },
+        // cgroup
+        { "mkcgroup", mkcgroup_lua },
+        { "rmcgroup", rmcgroup_lua },
+        { "cgroupstat", cgroupstat_lua },
+        // statistics
+        { "stats", stats_lua },
+        { "resetstats", resetstats_lua },
         // suspend process
         { "sleep", sleep_lua },
         { "nsleep", nsleep_lua },
+        { "clocksleep", clocksleep_lua },
         // errors
         { "errno", errno_lua },
         { "strerror", strerror_lua },
         // time
         { "gettimeofday", gettimeofday_lua },
+        { "clock", clock_lua },
         // descriptor
         { "dup", dup_lua },
         { "dup2", dup2_lua },
@@ -802,11 +1455,45 @@ LUALIB_API int luaopen_process( lua_State *L )
         lauxh_pushfn2tbl( L, ptr->name, ptr->func );
         ptr++;
     } while( ptr->name );
+    // add buffer constructor
+    lua_pushstring( L, "buffer" );
+    luaopen_process_buffer( L );
+    lua_rawset( L, -3 );
+    // add pool constructor
+    lua_pushstring( L, "pool" );
+    luaopen_process_pool( L );
+    lua_rawset( L, -3 );
+    // add fork server constructor
+    lua_pushstring( L, "forkserver" );
+    luaopen_process_forkserver( L );
+    lua_rawset( L, -3 );
+    // add poller constructor
+    lua_pushstring( L, "poller" );
+    luaopen_process_poller( L );
+    lua_rawset( L, -3 );
+    // add command constructor
+    lua_pushstring( L, "command" );
+    luaopen_process_command( L );
+    lua_rawset( L, -3 );
 
     // set waitpid options
 #define GEN_WAITPID_OPT_DECL
     // set errno
 #define GEN_ERRNO_DECL
+    // set open flags for stdio redirection
+#define GEN_OPEN_FLAG_DECL
+    // set getrusage targets
+#define GEN_RUSAGE_WHO_DECL
+    // set resource limits
+#define GEN_RLIMIT_DECL
+    // set clock ids and flags
+#define GEN_CLOCK_DECL
+    // set getpriority/setpriority targets
+#define GEN_PRIO_WHICH_DECL
+    // set scheduling policies
+#define GEN_SCHED_POLICY_DECL
+    // set i/o scheduling classes and targets
+#define GEN_IOPRIO_DECL
 
     return 1;
 }